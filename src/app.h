@@ -0,0 +1,51 @@
+/*
+ * app.h
+ * Runtime hooks main.c offers to the tuning shell (app_shell.c). The boot
+ * values come from Kconfig; changes are lost on reset.
+ */
+
+#ifndef APP_H_
+#define APP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct app_adv_tune {
+	uint16_t int_min_ms;       /* Connectable set interval */
+	uint16_t int_max_ms;
+	uint32_t burst_ms;
+	uint16_t growth_pct;
+	uint32_t downtime_max_ms;
+};
+
+void app_adv_tune_get(struct app_adv_tune *out);
+
+/* Validates and applies from the next burst; -EINVAL if out of range */
+int app_adv_tune_set(const struct app_adv_tune *in);
+
+/* PHY profiles, indexed 0..n-1; NULL past the last one */
+const char *app_adv_phy_name(unsigned int phy);
+unsigned int app_adv_phy_get(void);
+
+/* Applies from the next burst */
+int app_adv_phy_set(unsigned int phy);
+
+/* Advertising sets app_tx_power_set() reports on, in this order */
+#define APP_TX_SETS 5
+
+/* selected[] entry of a set the build does not create */
+#define APP_TX_POWER_NONE INT8_MAX
+
+/* Set names, indexed 0..APP_TX_SETS-1; NULL past the last one */
+const char *app_tx_set_name(unsigned int set);
+
+/*
+ * TX power through the Zephyr HCI vendor command, applied now to every
+ * advertising set and link, and to sets created later. selected gets the
+ * level the controller picked for each set (it rounds to what the radio
+ * supports, which need not be the same for every set).
+ */
+int app_tx_power_set(int8_t dbm, int8_t selected[APP_TX_SETS]);
+bool app_tx_power_get(int8_t *dbm);
+
+#endif /* APP_H_ */
@@ -0,0 +1,331 @@
+/*
+ * app_shell.c
+ * "app" shell commands for sweeping advertising, backoff and connection
+ * settings on a running board, plus dumps of the stats counters and the
+ * latency histograms.
+ * Everything applies immediately or from the next burst and is lost on
+ * reset; the Kconfig values are the defaults.
+ */
+
+#include <stdlib.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "app.h"
+#include "conn_policy.h"
+#include "hist.h"
+#include "stats.h"
+
+#define CONN_INT_MS(ms) ((ms) * 4 / 5)   /* 1.25 ms units */
+#define CONN_TIMEOUT_MS(ms) ((ms) / 10)  /* 10 ms units */
+
+/* In struct stats_snapshot order */
+static const char *const stats_names[] = {
+	"uptime_ms", "adv_on_ms", "connected_ms", "idle_ms",
+	"adv_starts", "connections", "pairing_ok", "pairing_failed",
+	"sec_lat_count", "sec_lat_min_us", "sec_lat_avg_us", "sec_lat_max_us",
+	"boot_to_adv_ms", "ntf_sent", "ntf_bytes", "ntf_failed", "ntf_stalls",
+	"bench_bytes_per_s", "bench_ntf_per_evt_x100",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(stats_names) == STATS_ENCODED_LEN / sizeof(uint32_t),
+	     "stats_names out of sync with struct stats_snapshot");
+
+static int parse_u32(const struct shell *sh, const char *arg, uint32_t *out)
+{
+	char *end;
+	unsigned long v = strtoul(arg, &end, 0);
+
+	if (*arg == '\0' || *end != '\0') {
+		shell_error(sh, "Not a number: %s", arg);
+		return -EINVAL;
+	}
+
+	*out = v;
+	return 0;
+}
+
+static int tune_apply(const struct shell *sh, const struct app_adv_tune *tune)
+{
+	int err = app_adv_tune_set(tune);
+
+	if (err) {
+		shell_error(sh, "Out of range");
+	}
+
+	return err;
+}
+
+static int cmd_adv_interval(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_adv_tune tune;
+	uint32_t min, max;
+
+	ARG_UNUSED(argc);
+
+	if (parse_u32(sh, argv[1], &min) || parse_u32(sh, argv[2], &max)) {
+		return -EINVAL;
+	}
+
+	app_adv_tune_get(&tune);
+	tune.int_min_ms = MIN(min, UINT16_MAX);
+	tune.int_max_ms = MIN(max, UINT16_MAX);
+	return tune_apply(sh, &tune);
+}
+
+static int cmd_adv_burst(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_adv_tune tune;
+	uint32_t ms;
+
+	ARG_UNUSED(argc);
+
+	if (parse_u32(sh, argv[1], &ms)) {
+		return -EINVAL;
+	}
+
+	app_adv_tune_get(&tune);
+	tune.burst_ms = ms;
+	return tune_apply(sh, &tune);
+}
+
+static int cmd_adv_growth(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_adv_tune tune;
+	uint32_t pct;
+
+	ARG_UNUSED(argc);
+
+	if (parse_u32(sh, argv[1], &pct)) {
+		return -EINVAL;
+	}
+
+	app_adv_tune_get(&tune);
+	tune.growth_pct = MIN(pct, UINT16_MAX);
+	return tune_apply(sh, &tune);
+}
+
+static int cmd_adv_cap(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_adv_tune tune;
+	uint32_t ms;
+
+	ARG_UNUSED(argc);
+
+	if (parse_u32(sh, argv[1], &ms)) {
+		return -EINVAL;
+	}
+
+	app_adv_tune_get(&tune);
+	tune.downtime_max_ms = ms;
+	return tune_apply(sh, &tune);
+}
+
+static int cmd_adv_phy(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t phy;
+
+	if (argc < 2) {
+		for (unsigned int i = 0; app_adv_phy_name(i); i++) {
+			shell_print(sh, "%c %u: %s", i == app_adv_phy_get() ? '*' : ' ',
+				    i, app_adv_phy_name(i));
+		}
+		return 0;
+	}
+
+	if (parse_u32(sh, argv[1], &phy) || app_adv_phy_set(phy)) {
+		shell_error(sh, "Unknown profile; 'app adv phy' lists them");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int cmd_adv_txpower(const struct shell *sh, size_t argc, char **argv)
+{
+	char *end;
+	long dbm = strtol(argv[1], &end, 10);
+	int8_t selected[APP_TX_SETS];
+	int err;
+
+	ARG_UNUSED(argc);
+
+	if (*end != '\0' || dbm < INT8_MIN || dbm > INT8_MAX) {
+		shell_error(sh, "Not a dBm value: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	err = app_tx_power_set((int8_t)dbm, selected);
+	if (err) {
+		shell_error(sh, "TX power write failed (err %d)", err);
+		return err;
+	}
+
+	/* The controller rounds per set, so each one gets its own line */
+	shell_print(sh, "TX power %ld dBm requested", dbm);
+	for (int i = 0; i < APP_TX_SETS; i++) {
+		if (selected[i] != APP_TX_POWER_NONE) {
+			shell_print(sh, "  %s: %d dBm selected", app_tx_set_name(i),
+				    selected[i]);
+		}
+	}
+	return 0;
+}
+
+/* app conn <idle|fast> <int_min_ms> <int_max_ms> <latency> <timeout_ms> */
+static int cmd_conn_profile(const struct shell *sh, bool fast, char **argv)
+{
+	struct bt_le_conn_param param;
+	uint32_t v[4];
+
+	for (int i = 0; i < ARRAY_SIZE(v); i++) {
+		if (parse_u32(sh, argv[1 + i], &v[i])) {
+			return -EINVAL;
+		}
+	}
+
+	param.interval_min = CONN_INT_MS(MIN(v[0], 4000));
+	param.interval_max = CONN_INT_MS(MIN(v[1], 4000));
+	param.latency = MIN(v[2], UINT16_MAX);
+	param.timeout = CONN_TIMEOUT_MS(MIN(v[3], 32000));
+
+	if (conn_policy_profile_set(fast, &param)) {
+		shell_error(sh, "Invalid connection parameters");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int cmd_conn_idle(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+
+	return cmd_conn_profile(sh, false, argv);
+}
+
+static int cmd_conn_fast(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+
+	return cmd_conn_profile(sh, true, argv);
+}
+
+static void print_conn_profile(const struct shell *sh, const char *name, bool fast)
+{
+	struct bt_le_conn_param p;
+
+	conn_policy_profile_get(fast, &p);
+	shell_print(sh, "conn %s: interval %u-%u ms, latency %u, timeout %u ms", name,
+		    p.interval_min * 5 / 4, p.interval_max * 5 / 4, p.latency, p.timeout * 10);
+}
+
+static int cmd_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_adv_tune tune;
+	int8_t dbm;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	app_adv_tune_get(&tune);
+	shell_print(sh, "adv: interval %u-%u ms, PHY %s", tune.int_min_ms, tune.int_max_ms,
+		    app_adv_phy_name(app_adv_phy_get()));
+	shell_print(sh, "backoff: burst %u ms, growth %u%%, cap %u ms",
+		    tune.burst_ms, tune.growth_pct, tune.downtime_max_ms);
+
+	if (app_tx_power_get(&dbm)) {
+		shell_print(sh, "tx power: %d dBm requested", dbm);
+	} else {
+		shell_print(sh, "tx power: controller default");
+	}
+
+	print_conn_profile(sh, "idle", false);
+	print_conn_profile(sh, "fast", true);
+	return 0;
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct stats_snapshot snap;
+	const uint32_t *fields = (const uint32_t *)&snap;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	stats_get(&snap);
+
+	for (int i = 0; i < ARRAY_SIZE(stats_names); i++) {
+		shell_print(sh, "%-24s %u", stats_names[i], fields[i]);
+	}
+
+	return 0;
+}
+
+static int cmd_hist(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t counts[HIST_BUCKETS];
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int id = 0; id < HIST_COUNT; id++) {
+		shell_print(sh, "%s:", hist_name(id));
+		hist_get(id, counts);
+
+		for (int b = 0; b < HIST_BUCKETS; b++) {
+			if (counts[b]) {
+				shell_print(sh, "  [2^%-2d us] %u", b, counts[b]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_hist_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	hist_reset();
+	shell_print(sh, "Histograms cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(app_hist_cmds,
+	SHELL_CMD(reset, NULL, "Clear all histograms", cmd_hist_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(app_adv_cmds,
+	SHELL_CMD_ARG(interval, NULL, "<min_ms> <max_ms>  connectable interval",
+		      cmd_adv_interval, 3, 0),
+	SHELL_CMD_ARG(burst, NULL, "<ms>  burst length", cmd_adv_burst, 2, 0),
+	SHELL_CMD_ARG(growth, NULL, "<pct>  downtime growth factor", cmd_adv_growth, 2, 0),
+	SHELL_CMD_ARG(cap, NULL, "<ms>  maximum downtime", cmd_adv_cap, 2, 0),
+	SHELL_CMD_ARG(phy, NULL, "[index]  list or select PHY profile", cmd_adv_phy, 1, 1),
+	SHELL_CMD_ARG(txpower, NULL, "<dBm>  TX power of all sets and links",
+		      cmd_adv_txpower, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(app_conn_cmds,
+	SHELL_CMD_ARG(idle, NULL, "<int_min_ms> <int_max_ms> <latency> <timeout_ms>",
+		      cmd_conn_idle, 5, 0),
+	SHELL_CMD_ARG(fast, NULL, "<int_min_ms> <int_max_ms> <latency> <timeout_ms>",
+		      cmd_conn_fast, 5, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(app_cmds,
+	SHELL_CMD(adv, &app_adv_cmds, "Advertising and backoff", NULL),
+	SHELL_CMD(conn, &app_conn_cmds, "Connection parameter targets", NULL),
+	SHELL_CMD(show, NULL, "Current settings", cmd_show),
+	SHELL_CMD(stats, NULL, "Dump stats counters", cmd_stats),
+	SHELL_CMD(hist, &app_hist_cmds, "Dump latency histograms", cmd_hist),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(app, &app_cmds, "Runtime tuning", NULL);
@@ -0,0 +1,120 @@
+/*
+ * battery.c
+ * Supply voltage through the SAADC channel listed in io-channels of the
+ * zephyr,user node. There is no sampling timer: the caller measures when it
+ * is awake anyway (start of each advertising burst). Millivolts map linearly
+ * to percent between CONFIG_APP_BATTERY_EMPTY_MV and _FULL_MV, which is
+ * coarse but enough to pick a profile.
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/logging/log.h>
+
+#include "battery.h"
+
+LOG_MODULE_REGISTER(battery, LOG_LEVEL_INF);
+
+#define USER_NODE DT_PATH(zephyr_user)
+
+BUILD_ASSERT(DT_NODE_HAS_PROP(USER_NODE, io_channels),
+	     "CONFIG_APP_BATTERY needs io-channels in the zephyr,user node");
+BUILD_ASSERT(CONFIG_APP_BATTERY_FULL_MV > CONFIG_APP_BATTERY_EMPTY_MV,
+	     "Battery full voltage must be above the empty voltage");
+BUILD_ASSERT(CONFIG_APP_BATTERY_FRESH_PCT > CONFIG_APP_BATTERY_LOW_PCT &&
+	     CONFIG_APP_BATTERY_LOW_PCT > CONFIG_APP_BATTERY_CRITICAL_PCT,
+	     "Battery thresholds must be fresh > low > critical");
+
+#define PROFILE_HYST_PCT 5
+
+static const struct adc_dt_spec vbat = ADC_DT_SPEC_GET(USER_NODE);
+
+/* Lowest charge each profile still holds at */
+static const uint8_t profile_floor_pct[BATTERY_PROFILE_COUNT] = {
+	[BATTERY_FRESH] = CONFIG_APP_BATTERY_FRESH_PCT,
+	[BATTERY_NOMINAL] = CONFIG_APP_BATTERY_LOW_PCT,
+	[BATTERY_LOW] = CONFIG_APP_BATTERY_CRITICAL_PCT,
+	[BATTERY_CRITICAL] = 0,
+};
+
+static const char *const profile_names[BATTERY_PROFILE_COUNT] = {
+	[BATTERY_FRESH] = "fresh",
+	[BATTERY_NOMINAL] = "nominal",
+	[BATTERY_LOW] = "low",
+	[BATTERY_CRITICAL] = "critical",
+};
+
+int battery_init(void)
+{
+	int err;
+
+	if (!adc_is_ready_dt(&vbat)) {
+		LOG_ERR("ADC not ready");
+		return -ENODEV;
+	}
+
+	err = adc_channel_setup_dt(&vbat);
+	if (err) {
+		LOG_ERR("ADC channel setup failed (err %d)", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int battery_measure(uint16_t *mv, uint8_t *pct)
+{
+	int16_t raw;
+	int32_t val;
+	struct adc_sequence seq = {
+		.buffer = &raw,
+		.buffer_size = sizeof(raw),
+	};
+	int err;
+
+	err = adc_sequence_init_dt(&vbat, &seq);
+	if (err) {
+		return err;
+	}
+
+	err = adc_read_dt(&vbat, &seq);
+	if (err) {
+		return err;
+	}
+
+	val = raw;
+	err = adc_raw_to_millivolts_dt(&vbat, &val);
+	if (err) {
+		return err;
+	}
+
+	val = MAX(val, 0);
+	*mv = MIN(val, UINT16_MAX);
+	*pct = CLAMP((val - CONFIG_APP_BATTERY_EMPTY_MV) * 100 /
+		     (CONFIG_APP_BATTERY_FULL_MV - CONFIG_APP_BATTERY_EMPTY_MV), 0, 100);
+	return 0;
+}
+
+enum battery_profile battery_profile_select(uint8_t pct, enum battery_profile current)
+{
+	int p = BATTERY_FRESH;
+
+	while (p < BATTERY_CRITICAL && pct < profile_floor_pct[p]) {
+		p++;
+	}
+
+	while (p < current && pct < profile_floor_pct[p] + PROFILE_HYST_PCT) {
+		p++;
+	}
+
+	return p;
+}
+
+const char *battery_profile_name(enum battery_profile profile)
+{
+	return profile < BATTERY_PROFILE_COUNT ? profile_names[profile] : "?";
+}
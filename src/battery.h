@@ -0,0 +1,32 @@
+/*
+ * battery.h
+ * On-demand supply voltage sampling and the advertising profile it selects.
+ */
+
+#ifndef BATTERY_H_
+#define BATTERY_H_
+
+#include <stdint.h>
+
+/* Ordered from most to least charge */
+enum battery_profile {
+	BATTERY_FRESH,     /* Short downtime */
+	BATTERY_NOMINAL,   /* Kconfig / shell values as they are */
+	BATTERY_LOW,       /* Slower interval, longer downtime */
+	BATTERY_CRITICAL,  /* Slowest, LEDs and logging off */
+	BATTERY_PROFILE_COUNT,
+};
+
+int battery_init(void);
+
+/* One SAADC conversion; pct is 0..100 between the empty and full voltages */
+int battery_measure(uint16_t *mv, uint8_t *pct);
+
+/* Profile for pct given the current one; moving to a better profile needs
+ * a few percent above the threshold so a sagging cell does not flap.
+ */
+enum battery_profile battery_profile_select(uint8_t pct, enum battery_profile current);
+
+const char *battery_profile_name(enum battery_profile profile);
+
+#endif /* BATTERY_H_ */
@@ -0,0 +1,169 @@
+/*
+ * bench.c
+ * Runs in its own low-priority thread so a run never holds up the main loop
+ * or the system workqueue. Samples are 4-byte little-endian sequence numbers,
+ * so a receiver can spot gaps, and a whole number of them fills a 244-byte
+ * notification. Throughput counts bytes the stack reported as sent.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include "bench.h"
+#include "conn_policy.h"
+#include "service.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(bench, LOG_LEVEL_INF);
+
+#define BENCH_SUBSCRIBE_WAIT_MS 10000
+#define BENCH_RETRY_MS 1
+
+static K_SEM_DEFINE(bench_sem, 0, 1);
+static struct bt_conn *bench_conn;
+static atomic_t bench_busy;
+
+void bench_start(struct bt_conn *conn)
+{
+	if (!atomic_cas(&bench_busy, 0, 1)) {
+		LOG_WRN("Benchmark already running");
+		return;
+	}
+
+	bench_conn = bt_conn_ref(conn);
+	k_sem_give(&bench_sem);
+}
+
+bool bench_running(void)
+{
+	return atomic_get(&bench_busy);
+}
+
+/* The peer may still be discovering the service when the run is requested */
+static bool bench_wait_subscribed(struct bt_conn *conn)
+{
+	for (int waited = 0; waited < BENCH_SUBSCRIBE_WAIT_MS; waited += 100) {
+		if (service_data_subscribed(conn)) {
+			return true;
+		}
+		k_sleep(K_MSEC(100));
+	}
+
+	return false;
+}
+
+static void bench_report(struct bt_conn *conn, const struct stats_snapshot *a,
+			 const struct stats_snapshot *b)
+{
+	struct bt_conn_info info;
+	uint32_t elapsed_ms = b->uptime_ms - a->uptime_ms;
+	uint32_t sent = b->ntf_sent - a->ntf_sent;
+	uint32_t bytes = b->ntf_bytes - a->ntf_bytes;
+	uint32_t interval_us = 0;
+	uint32_t bytes_per_s = elapsed_ms ? (uint32_t)((uint64_t)bytes * 1000 / elapsed_ms) : 0;
+	uint32_t per_evt_x100 = 0;
+
+	/* Interval at the end of the run; conn_policy keeps the fast one while data flows */
+	if (bt_conn_get_info(conn, &info) == 0) {
+		interval_us = info.le.interval * 1250U;
+	}
+
+	if (interval_us) {
+		uint64_t events = (uint64_t)elapsed_ms * 1000 / interval_us;
+
+		per_evt_x100 = events ? (uint32_t)((uint64_t)sent * 100 / events) : 0;
+	}
+
+	stats_bench_result(bytes_per_s, per_evt_x100);
+
+	LOG_INF("Benchmark: %u B/s, %u.%02u notif/event, %u notif, %u failed, %u stalls",
+		bytes_per_s, per_evt_x100 / 100, per_evt_x100 % 100, sent,
+		b->ntf_failed - a->ntf_failed, b->ntf_stalls - a->ntf_stalls);
+	LOG_INF("Benchmark link: MTU %u, interval %u us, %u ms",
+		bt_gatt_get_mtu(conn), interval_us, elapsed_ms);
+}
+
+static void bench_run(struct bt_conn *conn)
+{
+	struct stats_snapshot before, after;
+	uint8_t sample[4];
+	uint32_t seq = 0;
+	int64_t now, end, next_activity = 0;
+	uint32_t stream_end_ms;
+	int err = 0;
+
+	if (!bench_wait_subscribed(conn)) {
+		LOG_WRN("Benchmark: peer did not enable notifications on 0x%04x",
+			BT_UUID_APP_DATA_VAL);
+		return;
+	}
+
+	LOG_INF("Benchmark: streaming for %d s", CONFIG_APP_BENCH_DURATION_S);
+	stats_get(&before);
+	end = k_uptime_get() + CONFIG_APP_BENCH_DURATION_S * MSEC_PER_SEC;
+
+	while ((now = k_uptime_get()) < end) {
+		/* Keep conn_policy on the fast profile for the whole run */
+		if (now >= next_activity) {
+			conn_policy_activity(conn);
+			next_activity = now + CONFIG_APP_CONN_FAST_HOLD_MS / 2;
+		}
+
+		sys_put_le32(seq, sample);
+
+		err = service_data_push(conn, sample, sizeof(sample));
+		if (err == -EAGAIN || err == -ENOMEM) {
+			/* Stalled on buffers; counted by the service */
+			k_sleep(K_MSEC(BENCH_RETRY_MS));
+			continue;
+		}
+
+		if (err) {
+			break;
+		}
+
+		seq++;
+	}
+
+	/* Out of TX buffers keeps the tail batch; retry until it goes or the
+	 * send fails for good (which frees it), so no batch outlives the run
+	 */
+	while (service_data_flush(conn) == -EAGAIN) {
+		k_sleep(K_MSEC(BENCH_RETRY_MS));
+	}
+	stream_end_ms = (uint32_t)k_uptime_get();
+
+	/* Let the notifications still in flight complete before sampling,
+	 * but measure the rate over the streaming time only.
+	 */
+	k_sleep(K_MSEC(100));
+	stats_get(&after);
+	after.uptime_ms = stream_end_ms;
+
+	if (err) {
+		LOG_WRN("Benchmark stopped early (err %d)", err);
+	}
+
+	bench_report(conn, &before, &after);
+}
+
+static void bench_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1); ARG_UNUSED(p2); ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&bench_sem, K_FOREVER);
+
+		bench_run(bench_conn);
+
+		bt_conn_unref(bench_conn);
+		bench_conn = NULL;
+		atomic_set(&bench_busy, 0);
+	}
+}
+
+K_THREAD_DEFINE(bench_tid, 1536, bench_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
@@ -0,0 +1,20 @@
+/*
+ * bench.h
+ * GATT throughput benchmark: streams the 0x2224 data characteristic as fast
+ * as the stack allows for CONFIG_APP_BENCH_DURATION_S and records the result
+ * in the stats module.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdbool.h>
+
+#include <zephyr/bluetooth/conn.h>
+
+/* Start a run on conn; ignored while a run is in progress */
+void bench_start(struct bt_conn *conn);
+
+bool bench_running(void);
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,292 @@
+/*
+ * bonds.c
+ * One entry per bond: local identity, peer identity address and the value
+ * of a connection counter when the peer was last seen. The counter, not the
+ * uptime, orders the entries, so the order survives a reboot; the table is
+ * saved as "bonds/lru" a while after it changes. Lookups never touch the
+ * settings backend. Called from the BT RX thread and the system workqueue,
+ * so the table is under a spinlock; bt_unpair() runs outside it.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/logging/log.h>
+
+#include "bonds.h"
+
+LOG_MODULE_REGISTER(bonds, LOG_LEVEL_INF);
+
+struct bond_entry {
+	bt_addr_le_t addr;
+	uint8_t id;
+	uint32_t seen;  /* 0: not seen since the index was built */
+};
+
+static struct k_spinlock lock;
+static struct bond_entry table[CONFIG_BT_MAX_PAIRED];
+static size_t table_len;
+static uint32_t seen_seq;
+
+/* Copy loaded from settings before bonds_init() merges it */
+static struct bond_entry stored[CONFIG_BT_MAX_PAIRED];
+static size_t stored_len;
+
+static struct k_work_delayable save_work;
+
+static int find(uint8_t id, const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < table_len; i++) {
+		if (table[i].id == id && bt_addr_le_eq(&table[i].addr, addr)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void remove_at(int i)
+{
+	table[i] = table[--table_len];
+}
+
+static size_t snapshot(struct bond_entry out[CONFIG_BT_MAX_PAIRED])
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	size_t len = table_len;
+
+	memcpy(out, table, len * sizeof(out[0]));
+	k_spin_unlock(&lock, key);
+	return len;
+}
+
+/* ---- Persistence ---- */
+static int bonds_settings_set(const char *name, size_t len,
+			      settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+
+	if (!settings_name_steq(name, "lru", &next) || next) {
+		return -ENOENT;
+	}
+
+	if (len % sizeof(struct bond_entry) || len > sizeof(stored)) {
+		return -EINVAL;
+	}
+
+	ssize_t rc = read_cb(cb_arg, stored, len);
+
+	if (rc < 0) {
+		return rc;
+	}
+
+	stored_len = rc / sizeof(struct bond_entry);
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(bonds, "bonds", NULL, bonds_settings_set, NULL, NULL);
+
+static void save_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	struct bond_entry copy[CONFIG_BT_MAX_PAIRED];
+	size_t len = snapshot(copy);
+
+	int err = settings_save_one("bonds/lru", copy, len * sizeof(copy[0]));
+	if (err) {
+		LOG_WRN("Bond index save failed (err %d)", err);
+	}
+}
+
+static void changed(void)
+{
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		k_work_schedule(&save_work, K_MSEC(CONFIG_APP_SETTINGS_SAVE_DELAY_MS));
+	}
+}
+
+void bonds_flush(void)
+{
+	if (k_work_delayable_is_pending(&save_work)) {
+		k_work_cancel_delayable(&save_work);
+		save_work_fn(NULL);
+	}
+}
+
+/* ---- Index ---- */
+static void add_bond(const struct bt_bond_info *info, void *user_data)
+{
+	uint8_t id = *(uint8_t *)user_data;
+
+	if (table_len == ARRAY_SIZE(table)) {
+		return;
+	}
+
+	table[table_len].id = id;
+	bt_addr_le_copy(&table[table_len].addr, &info->addr);
+	table[table_len].seen = 0;
+
+	/* Carry over the age from the stored copy */
+	for (int i = 0; i < stored_len; i++) {
+		if (stored[i].id == id && bt_addr_le_eq(&stored[i].addr, &info->addr)) {
+			table[table_len].seen = stored[i].seen;
+			seen_seq = MAX(seen_seq, stored[i].seen);
+			break;
+		}
+	}
+
+	table_len++;
+}
+
+int bonds_init(void)
+{
+	k_work_init_delayable(&save_work, save_work_fn);
+
+	/* Only this thread runs until the stack reports connections */
+	table_len = 0;
+	for (uint8_t id = 0; id < CONFIG_BT_ID_MAX; id++) {
+		bt_foreach_bond(id, add_bond, &id);
+	}
+
+	if (table_len != stored_len) {
+		changed();
+	}
+
+	LOG_INF("Bond index: %zu of %d", table_len, CONFIG_BT_MAX_PAIRED);
+	return 0;
+}
+
+void bonds_seen(uint8_t id, const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int i = find(id, addr);
+
+	/* The index holds as many entries as the stack holds keys */
+	if (i < 0 && table_len < ARRAY_SIZE(table)) {
+		i = table_len++;
+		table[i].id = id;
+		bt_addr_le_copy(&table[i].addr, addr);
+	}
+
+	if (i >= 0) {
+		table[i].seen = ++seen_seq;
+	}
+	k_spin_unlock(&lock, key);
+
+	changed();
+}
+
+void bonds_deleted(uint8_t id, const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int i = find(id, addr);
+
+	if (i >= 0) {
+		remove_at(i);
+	}
+	k_spin_unlock(&lock, key);
+
+	if (i >= 0) {
+		changed();
+	}
+}
+
+bool bonds_is_bonded(uint8_t id, const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool bonded = find(id, addr) >= 0;
+
+	k_spin_unlock(&lock, key);
+	return bonded;
+}
+
+bool bonds_is_bonded_any(const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool bonded = false;
+
+	for (int i = 0; i < table_len && !bonded; i++) {
+		bonded = bt_addr_le_eq(&table[i].addr, addr);
+	}
+	k_spin_unlock(&lock, key);
+
+	return bonded;
+}
+
+size_t bonds_recent(uint8_t id, bt_addr_le_t *out, size_t max)
+{
+	struct bond_entry copy[CONFIG_BT_MAX_PAIRED];
+	size_t len = snapshot(copy);
+	size_t n = 0;
+
+	/* Insertion sort by last seen, newest first; a handful of entries */
+	for (int i = 0; i < len; i++) {
+		struct bond_entry e = copy[i];
+		int j;
+
+		if (e.id != id) {
+			continue;
+		}
+
+		for (j = n; j > 0 && copy[j - 1].seen < e.seen; j--) {
+			copy[j] = copy[j - 1];
+		}
+		copy[j] = e;
+		n++;
+	}
+
+	n = MIN(n, max);
+	for (int i = 0; i < n; i++) {
+		bt_addr_le_copy(&out[i], &copy[i].addr);
+	}
+
+	return n;
+}
+
+int bonds_make_room(void)
+{
+	struct bond_entry copy[CONFIG_BT_MAX_PAIRED];
+	size_t len = snapshot(copy);
+	int lru = -1;
+
+	if (len < ARRAY_SIZE(copy)) {
+		return 0;
+	}
+
+	for (int i = 0; i < len; i++) {
+		struct bt_conn *conn = bt_conn_lookup_addr_le(copy[i].id, &copy[i].addr);
+
+		if (conn) {
+			bt_conn_unref(conn);
+			continue;
+		}
+
+		if (lru < 0 || copy[i].seen < copy[lru].seen) {
+			lru = i;
+		}
+	}
+
+	if (lru < 0) {
+		LOG_WRN("Bond storage full and every bonded peer is connected");
+		return -ENOMEM;
+	}
+
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	bt_addr_le_to_str(&copy[lru].addr, addr, sizeof(addr));
+	LOG_INF("Bond storage full; evicting least recently seen %s", addr);
+
+	int err = bt_unpair(copy[lru].id, &copy[lru].addr);
+	if (err) {
+		LOG_WRN("Unpair failed (err %d)", err);
+		return err;
+	}
+
+	bonds_deleted(copy[lru].id, &copy[lru].addr);
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * bonds.h
+ * RAM index of bonded peers ordered by last connection, with least recently
+ * used eviction when a new bond fills the key storage.
+ */
+
+#ifndef BONDS_H_
+#define BONDS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/addr.h>
+
+/* Build the index from the stack's bonds and the stored ages; call once the
+ * "bt" and "bonds" settings are loaded and all identities exist
+ */
+int bonds_init(void);
+
+/* Bonded peer connected or just paired on local identity id */
+void bonds_seen(uint8_t id, const bt_addr_le_t *addr);
+
+/* Bond removed by the stack or by bonds_make_room() */
+void bonds_deleted(uint8_t id, const bt_addr_le_t *addr);
+
+bool bonds_is_bonded(uint8_t id, const bt_addr_le_t *addr);
+
+/* True if addr is bonded on any local identity */
+bool bonds_is_bonded_any(const bt_addr_le_t *addr);
+
+/* Up to max peers bonded on id, most recently seen first. Returns the count. */
+size_t bonds_recent(uint8_t id, bt_addr_le_t *out, size_t max);
+
+/* Write a pending index change now rather than after the save delay */
+void bonds_flush(void);
+
+/* Call after a bond is created. If it filled the key storage, unpair the
+ * least recently seen peer that is not connected so the next new peer has a
+ * key slot to pair into. Returns -ENOMEM if every bonded peer is connected.
+ * Thread context; bt_unpair() writes flash.
+ */
+int bonds_make_room(void);
+
+#endif /* BONDS_H_ */
@@ -0,0 +1,223 @@
+/*
+ * conn_policy.c
+ * Requests go through bt_conn_le_param_update() from the system workqueue,
+ * never from the BT RX thread callbacks that trigger them. The same goes for
+ * the MTU/DLE/PHY requests sent once per link by tune_work.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+
+#include "conn_policy.h"
+
+LOG_MODULE_REGISTER(conn_policy, LOG_LEVEL_INF);
+
+#define CONN_INT_MS(ms) ((ms) * 4 / 5)   /* 1.25 ms units */
+#define CONN_TIMEOUT_MS(ms) ((ms) / 10)  /* 10 ms units */
+
+/* Boot values from Kconfig, changed at runtime by conn_policy_profile_set() */
+static struct bt_le_conn_param idle_param = {
+	.interval_min = CONN_INT_MS(CONFIG_APP_CONN_IDLE_INT_MIN_MS),
+	.interval_max = CONN_INT_MS(CONFIG_APP_CONN_IDLE_INT_MAX_MS),
+	.latency = CONFIG_APP_CONN_IDLE_LATENCY,
+	.timeout = CONN_TIMEOUT_MS(CONFIG_APP_CONN_IDLE_TIMEOUT_MS),
+};
+
+static struct bt_le_conn_param fast_param = {
+	.interval_min = CONN_INT_MS(CONFIG_APP_CONN_FAST_INT_MIN_MS),
+	.interval_max = CONN_INT_MS(CONFIG_APP_CONN_FAST_INT_MAX_MS),
+	.latency = 0,
+	.timeout = CONN_TIMEOUT_MS(CONFIG_APP_CONN_FAST_TIMEOUT_MS),
+};
+
+struct policy_state {
+	struct bt_conn *conn;          /* Set once secured, holds a reference */
+	bool want_fast;
+	bool is_fast;
+	struct k_work update_work;
+	struct k_work_delayable idle_work;
+	struct bt_conn *tune_conn;     /* Set until tune_work has run */
+	struct k_work tune_work;
+	struct bt_gatt_exchange_params mtu_params;
+};
+
+static struct policy_state states[CONFIG_BT_MAX_CONN];
+
+static void update_work_fn(struct k_work *work)
+{
+	struct policy_state *st = CONTAINER_OF(work, struct policy_state, update_work);
+	struct bt_conn *conn = st->conn;
+	bool fast = st->want_fast;
+
+	if (!conn || fast == st->is_fast) {
+		return;
+	}
+
+	int err = bt_conn_le_param_update(conn, fast ? &fast_param : &idle_param);
+	if (err) {
+		LOG_WRN("Conn param update (%s) failed: %d", fast ? "fast" : "idle", err);
+		return;
+	}
+
+	st->is_fast = fast;
+	LOG_INF("Requested %s connection parameters", fast ? "fast" : "idle");
+}
+
+static void idle_work_fn(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct policy_state *st = CONTAINER_OF(dwork, struct policy_state, idle_work);
+
+	st->want_fast = false;
+	k_work_submit(&st->update_work);
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	ARG_UNUSED(params);
+
+	if (err) {
+		LOG_WRN("MTU exchange failed: 0x%02x", err);
+		return;
+	}
+
+	LOG_INF("ATT MTU %u", bt_gatt_get_mtu(conn));
+}
+
+static void tune_work_fn(struct k_work *work)
+{
+	struct policy_state *st = CONTAINER_OF(work, struct policy_state, tune_work);
+	struct bt_conn *conn = st->tune_conn;
+	int err;
+
+	if (!conn) {
+		return;
+	}
+
+	st->mtu_params.func = mtu_exchanged;
+	err = bt_gatt_exchange_mtu(conn, &st->mtu_params);
+	if (err) {
+		LOG_WRN("MTU exchange request failed: %d", err);
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("Data length update failed: %d", err);
+	}
+
+	err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err) {
+		LOG_WRN("PHY update failed: %d", err);
+	}
+
+	bt_conn_unref(conn);
+	st->tune_conn = NULL;
+}
+
+void conn_policy_init(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(states); i++) {
+		k_work_init(&states[i].update_work, update_work_fn);
+		k_work_init_delayable(&states[i].idle_work, idle_work_fn);
+		k_work_init(&states[i].tune_work, tune_work_fn);
+	}
+}
+
+void conn_policy_connected(struct bt_conn *conn)
+{
+	struct policy_state *st = &states[bt_conn_index(conn)];
+
+	if (st->tune_conn) {
+		return;
+	}
+
+	st->tune_conn = bt_conn_ref(conn);
+	k_work_submit(&st->tune_work);
+}
+
+void conn_policy_secured(struct bt_conn *conn)
+{
+	struct policy_state *st = &states[bt_conn_index(conn)];
+
+	if (st->conn) {
+		return;
+	}
+
+	st->conn = bt_conn_ref(conn);
+	st->want_fast = false;
+	/* Whatever the central picked counts as fast until we ask for idle */
+	st->is_fast = true;
+	k_work_submit(&st->update_work);
+}
+
+void conn_policy_activity(struct bt_conn *conn)
+{
+	struct policy_state *st = &states[bt_conn_index(conn)];
+
+	if (!st->conn) {
+		return;
+	}
+
+	if (!st->want_fast) {
+		st->want_fast = true;
+		k_work_submit(&st->update_work);
+	}
+
+	k_work_reschedule(&st->idle_work, K_MSEC(CONFIG_APP_CONN_FAST_HOLD_MS));
+}
+
+void conn_policy_disconnected(struct bt_conn *conn)
+{
+	struct policy_state *st = &states[bt_conn_index(conn)];
+
+	k_work_cancel_delayable(&st->idle_work);
+	k_work_cancel(&st->update_work);
+	k_work_cancel(&st->tune_work);
+
+	if (st->tune_conn) {
+		bt_conn_unref(st->tune_conn);
+		st->tune_conn = NULL;
+	}
+
+	if (st->conn) {
+		bt_conn_unref(st->conn);
+		st->conn = NULL;
+	}
+}
+
+void conn_policy_profile_get(bool fast, struct bt_le_conn_param *out)
+{
+	*out = fast ? fast_param : idle_param;
+}
+
+int conn_policy_profile_set(bool fast, const struct bt_le_conn_param *param)
+{
+	/* Core spec ranges; timeout must outlast (1 + latency) intervals twice over */
+	if (param->interval_min < 6 || param->interval_max > 3200 ||
+	    param->interval_min > param->interval_max || param->latency > 499 ||
+	    param->timeout < 10 || param->timeout > 3200 ||
+	    param->timeout * 4U <= (1U + param->latency) * param->interval_max) {
+		return -EINVAL;
+	}
+
+	if (fast) {
+		fast_param = *param;
+	} else {
+		idle_param = *param;
+	}
+
+	/* Re-request the profile secured links are currently on */
+	for (int i = 0; i < ARRAY_SIZE(states); i++) {
+		struct policy_state *st = &states[i];
+
+		if (st->conn && st->want_fast == fast) {
+			st->is_fast = !fast;
+			k_work_submit(&st->update_work);
+		}
+	}
+
+	return 0;
+}
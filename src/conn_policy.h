@@ -0,0 +1,33 @@
+/*
+ * conn_policy.h
+ * Connection-parameter policy: long interval with peripheral latency once the
+ * link is secure and quiet, a fast interval while data is flowing. Right
+ * after connecting the link is also tuned for bulk transfers: larger ATT
+ * MTU, maximum data length and the 2M PHY.
+ */
+
+#ifndef CONN_POLICY_H_
+#define CONN_POLICY_H_
+
+#include <zephyr/bluetooth/conn.h>
+
+void conn_policy_init(void);
+
+/* New link: request MTU exchange, data length update and 2M PHY */
+void conn_policy_connected(struct bt_conn *conn);
+
+/* Link reached L3: move to the low-power idle profile */
+void conn_policy_secured(struct bt_conn *conn);
+
+/* GATT traffic: use the fast profile until the link goes quiet again */
+void conn_policy_activity(struct bt_conn *conn);
+
+void conn_policy_disconnected(struct bt_conn *conn);
+
+/* Runtime targets (1.25 ms / 10 ms units as in bt_le_conn_param) */
+void conn_policy_profile_get(bool fast, struct bt_le_conn_param *out);
+
+/* -EINVAL if out of range; links on that profile are updated now */
+int conn_policy_profile_set(bool fast, const struct bt_le_conn_param *param);
+
+#endif /* CONN_POLICY_H_ */
@@ -0,0 +1,78 @@
+/*
+ * hist.c
+ * Counters live in one static array under a spinlock; recording is a
+ * subtraction, a clz and an increment, cheap enough for the BT RX thread.
+ * Timestamps come from k_cycle_get_32(). On nRF52 that is the 32768 Hz RTC,
+ * so the resolution is about 30 us: buckets 0..4 only see samples that
+ * started and ended inside one tick.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "hist.h"
+
+static struct k_spinlock lock;
+static uint32_t counts[HIST_COUNT][HIST_BUCKETS];
+
+static const char *const names[HIST_COUNT] = {
+	[HIST_BTN_TO_ADV] = "btn_to_adv",
+	[HIST_CONN_TO_L3] = "conn_to_l3",
+	[HIST_DISC_TO_ADV] = "disc_to_adv",
+	[HIST_ADV_STOP] = "adv_stop",
+	[HIST_SETTINGS_SAVE] = "settings_save",
+};
+
+void hist_record_us(enum hist_id id, uint32_t us)
+{
+	unsigned int b = us ? 31 - __builtin_clz(us) : 0;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	counts[id][MIN(b, HIST_BUCKETS - 1)]++;
+	k_spin_unlock(&lock, key);
+}
+
+void hist_record_cyc(enum hist_id id, uint32_t start_cyc)
+{
+	hist_record_us(id, k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc));
+}
+
+const char *hist_name(enum hist_id id)
+{
+	return id < HIST_COUNT ? names[id] : NULL;
+}
+
+void hist_get(enum hist_id id, uint32_t out[HIST_BUCKETS])
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memcpy(out, counts[id], sizeof(counts[id]));
+	k_spin_unlock(&lock, key);
+}
+
+void hist_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(counts, 0, sizeof(counts));
+	k_spin_unlock(&lock, key);
+}
+
+size_t hist_encode(uint8_t *buf, size_t len)
+{
+	uint32_t bucket[HIST_BUCKETS];
+	size_t off = 0;
+
+	for (int id = 0; id < HIST_COUNT; id++) {
+		hist_get(id, bucket);
+
+		for (int b = 0; b < HIST_BUCKETS && off + sizeof(uint32_t) <= len; b++) {
+			sys_put_le32(bucket[b], &buf[off]);
+			off += sizeof(uint32_t);
+		}
+	}
+
+	return off;
+}
@@ -0,0 +1,41 @@
+/*
+ * hist.h
+ * Fixed log2-bucket latency histograms for paths where the tail matters
+ * more than the average.
+ */
+
+#ifndef HIST_H_
+#define HIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum hist_id {
+	HIST_BTN_TO_ADV,     /* SW0 edge in the ISR -> connectable set started */
+	HIST_CONN_TO_L3,     /* connected() -> security_changed(L3) */
+	HIST_DISC_TO_ADV,    /* disconnected() -> advertising again (reconnect or open) */
+	HIST_ADV_STOP,       /* adv_stop() duration, logging included */
+	HIST_SETTINGS_SAVE,  /* settings_save_work_fn() duration, flash writes included */
+	HIST_COUNT,
+};
+
+/* Bucket b counts latencies in [2^b, 2^(b+1)) us; 0 us lands in bucket 0,
+ * the last bucket also takes everything longer.
+ */
+#define HIST_BUCKETS 24
+
+#define HIST_ENCODED_LEN (HIST_COUNT * HIST_BUCKETS * sizeof(uint32_t))
+
+void hist_record_us(enum hist_id id, uint32_t us);
+
+/* Latency from start_cyc (k_cycle_get_32()) to now */
+void hist_record_cyc(enum hist_id id, uint32_t start_cyc);
+
+const char *hist_name(enum hist_id id);
+void hist_get(enum hist_id id, uint32_t out[HIST_BUCKETS]);
+void hist_reset(void);
+
+/* All histograms in enum order, bucket counts as little-endian uint32 */
+size_t hist_encode(uint8_t *buf, size_t len);
+
+#endif /* HIST_H_ */
@@ -0,0 +1,131 @@
+/*
+ * leds.c
+ * The DK LEDs draw more than the radio, so how they are driven is a
+ * build-time choice (CONFIG_APP_LED_POLICY_*):
+ *   ON     steady while the state holds
+ *   BLINK  show the new state for CONFIG_APP_LED_BLINK_MS after a change,
+ *          then dark until the next change
+ *   PWM    steady at CONFIG_APP_LED_PWM_DUTY_PCT through the pwm-leds
+ *          driver (pwm_leds.overlay)
+ *   OFF    pins are never configured
+ * leds_set() is called from the main thread, the system workqueue and the
+ * BT RX thread; the logical state is an atomic bitmask. leds_mute() darkens
+ * them on top of any policy.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/led.h>
+#include <zephyr/logging/log.h>
+
+#include "leds.h"
+
+LOG_MODULE_REGISTER(leds, LOG_LEVEL_INF);
+
+#if defined(CONFIG_APP_LED_POLICY_PWM)
+BUILD_ASSERT(DT_NODE_EXISTS(DT_NODELABEL(pwm_status_leds)),
+	     "CONFIG_APP_LED_POLICY_PWM needs pwm_leds.overlay");
+
+static const struct device *const pwm_leds = DEVICE_DT_GET(DT_NODELABEL(pwm_status_leds));
+#elif !defined(CONFIG_APP_LED_POLICY_OFF)
+/* LEDs (these aliases exist on Nordic DKs) */
+static const struct gpio_dt_spec gpio_leds[LEDS_COUNT] = {
+	GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(led1), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(led3), gpios),
+};
+#endif
+
+static atomic_t led_state;
+static atomic_t led_muted;
+static struct k_work_delayable blink_off_work;
+
+static void led_out(uint8_t led, bool on)
+{
+#if defined(CONFIG_APP_LED_POLICY_PWM)
+	led_set_brightness(pwm_leds, led, on ? CONFIG_APP_LED_PWM_DUTY_PCT : 0);
+#elif !defined(CONFIG_APP_LED_POLICY_OFF)
+	gpio_pin_set_dt(&gpio_leds[led], on ? 1 : 0);
+#else
+	ARG_UNUSED(led);
+	ARG_UNUSED(on);
+#endif
+}
+
+static void blink_off_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	for (uint8_t i = 0; i < LEDS_COUNT; i++) {
+		led_out(i, false);
+	}
+}
+
+int leds_init(void)
+{
+	k_work_init_delayable(&blink_off_work, blink_off_work_fn);
+
+#if defined(CONFIG_APP_LED_POLICY_PWM)
+	if (!device_is_ready(pwm_leds)) {
+		LOG_ERR("PWM LEDs not ready");
+		return -ENODEV;
+	}
+#elif !defined(CONFIG_APP_LED_POLICY_OFF)
+	for (int i = 0; i < LEDS_COUNT; i++) {
+		if (!device_is_ready(gpio_leds[i].port)) {
+			LOG_ERR("LED %d not ready", i);
+			return -ENODEV;
+		}
+		gpio_pin_configure_dt(&gpio_leds[i], GPIO_OUTPUT_INACTIVE);
+	}
+#else
+	LOG_INF("Status LEDs disabled");
+#endif
+
+	return 0;
+}
+
+void leds_set(uint8_t led, bool on)
+{
+	bool was_on = on ? atomic_test_and_set_bit(&led_state, led) :
+			   atomic_test_and_clear_bit(&led_state, led);
+
+	if (was_on == on || IS_ENABLED(CONFIG_APP_LED_POLICY_OFF) || atomic_get(&led_muted)) {
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_APP_LED_POLICY_BLINK)) {
+		/* Show the whole new state so the blink can be read at a glance */
+		for (uint8_t i = 0; i < LEDS_COUNT; i++) {
+			led_out(i, atomic_test_bit(&led_state, i));
+		}
+		k_work_reschedule(&blink_off_work, K_MSEC(CONFIG_APP_LED_BLINK_MS));
+		return;
+	}
+
+	led_out(led, on);
+}
+
+void leds_all_off(void)
+{
+	k_work_cancel_delayable(&blink_off_work);
+	atomic_clear(&led_state);
+	blink_off_work_fn(NULL);
+}
+
+void leds_mute(bool mute)
+{
+	if (atomic_set(&led_muted, mute) == mute || IS_ENABLED(CONFIG_APP_LED_POLICY_OFF)) {
+		return;
+	}
+
+	k_work_cancel_delayable(&blink_off_work);
+
+	/* A blink policy stays dark until the next change */
+	for (uint8_t i = 0; i < LEDS_COUNT; i++) {
+		led_out(i, !mute && !IS_ENABLED(CONFIG_APP_LED_POLICY_BLINK) &&
+			   atomic_test_bit(&led_state, i));
+	}
+}
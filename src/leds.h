@@ -0,0 +1,28 @@
+/*
+ * leds.h
+ * Status LED output policy. Callers set what each LED means; the policy
+ * chosen in Kconfig decides whether and how brightly it is shown.
+ */
+
+#ifndef LEDS_H_
+#define LEDS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LEDS_COUNT 4
+
+int leds_init(void);
+
+/* Logical state of LED led (0..LEDS_COUNT-1); only changes reach the pins */
+void leds_set(uint8_t led, bool on);
+
+/* Force every LED dark and forget the logical state (System OFF) */
+void leds_all_off(void);
+
+/* Keep the LEDs dark while muted, still tracking the logical state; the
+ * state is shown again on unmute (critical battery profile)
+ */
+void leds_mute(bool mute);
+
+#endif /* LEDS_H_ */
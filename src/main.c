@@ -1,9 +1,14 @@
 /*
  * main.c
  * Numeric Comparison bonding (phone shows code + user confirms), peripheral auto-accepts.
- * Keeps your SW0/SW1/SW2 advertising controls + RPA toggle.
+ * Keeps your SW0/SW1/SW2 advertising controls + RPA toggle (buttons debounced),
+ * SW3 cycles the advertising PHY profile; holding SW3 runs the GATT benchmark.
+ * Advertising runs in bursts separated by downtimes that grow after each burst;
+ * a long spell without a central ends in System OFF (any button wakes).
  */
 
+#include <string.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
@@ -11,9 +16,24 @@
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/hci_vs.h>
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/poweroff.h>
 
 #include <zephyr/settings/settings.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/logging/log_backend.h>
+#include <zephyr/logging/log_ctrl.h>
+
+#include "app.h"
+#include "battery.h"
+#include "bench.h"
+#include "bonds.h"
+#include "conn_policy.h"
+#include "hist.h"
+#include "leds.h"
+#include "stats.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
@@ -25,10 +45,28 @@ static const uint8_t uuid_custom_service[] = {
 	0x22, 0x22, 0x00, 0x00
 };
 
-/* Advertising data */
+/* Company ID 0xFFFF is reserved by the SIG for testing */
+#define APP_COMPANY_ID 0xFFFF
+
+/* Manufacturer data, refreshed in place by adv_mfg_refresh():
+ * company id (LE), sequence, uptime (h, saturating), backoff level, battery %
+ */
+#define ADV_MFG_SEQ     2
+#define ADV_MFG_FIELDS  3
+#define ADV_MFG_LEN     (ADV_MFG_FIELDS + 3)
+
+static uint8_t adv_mfg[ADV_MFG_LEN] = {
+	APP_COMPANY_ID & 0xff, APP_COMPANY_ID >> 8, 0, 0, 0, 0xff,
+};
+
+/* Battery level in percent, 0xFF until measured */
+static uint8_t battery_pct = 0xFF;
+
+/* Advertising data; the legacy PDU has 2 bytes to spare */
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_UUID128_ALL, uuid_custom_service, sizeof(uuid_custom_service)),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, adv_mfg, sizeof(adv_mfg)),
 };
 
 /* Scan response data: include name so Android shows it */
@@ -37,29 +75,74 @@ static const struct bt_data sd[] = {
 		sizeof(CONFIG_BT_DEVICE_NAME) - 1),
 };
 
-/* LEDs (these aliases exist on Nordic DKs) */
-static const struct gpio_dt_spec leds[] = {
-	GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios),
-	GPIO_DT_SPEC_GET(DT_ALIAS(led1), gpios),
-	GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpios),
-	GPIO_DT_SPEC_GET(DT_ALIAS(led3), gpios),
+/* Extended connectable PDUs cannot be scanned, so the name rides in ad */
+static const struct bt_data ad_ext[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_UUID128_ALL, uuid_custom_service, sizeof(uuid_custom_service)),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, adv_mfg, sizeof(adv_mfg)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME,
+		sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+
+/* Button events posted once a press is debounced; main() blocks on this queue */
+enum btn_evt {
+	BTN_EVT_START,
+	BTN_EVT_STOP,
+	BTN_EVT_TOGGLE,
+	BTN_EVT_SW3,
+	BTN_EVT_SW3_HOLD,
+};
+
+struct btn_msg {
+	uint8_t evt;
+	uint32_t isr_cyc;  /* k_cycle_get_32() at the first edge, for HIST_BTN_TO_ADV */
 };
-#define NUM_LEDS ARRAY_SIZE(leds)
 
-/* Buttons: sw0/sw1/sw2 aliases (portable across Nordic DKs) */
-static const struct gpio_dt_spec btn_start  = GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios); /* SW0 */
-static const struct gpio_dt_spec btn_stop   = GPIO_DT_SPEC_GET(DT_ALIAS(sw1), gpios); /* SW1 */
-static const struct gpio_dt_spec btn_toggle = GPIO_DT_SPEC_GET(DT_ALIAS(sw2), gpios); /* SW2 */
+K_MSGQ_DEFINE(btn_evt_q, sizeof(struct btn_msg), 8, 4);
 
-static struct gpio_callback btn_start_cb;
-static struct gpio_callback btn_stop_cb;
-static struct gpio_callback btn_toggle_cb;
+/* Buttons: button0..3 aliases from the board overlay.
+ * An edge disables the pin interrupt and arms a one-shot debounce timer;
+ * the timer confirms the level, posts the event and re-arms the interrupt.
+ * Buttons with a hold_ms keep the timer polling while pressed: release
+ * before hold_ms posts evt, holding posts hold_evt once.
+ */
+struct button {
+	struct gpio_dt_spec spec;
+	enum btn_evt evt;
+	enum btn_evt hold_evt;
+	uint16_t hold_ms;  /* 0: no hold detection */
+	uint16_t held_ms;
+	uint32_t isr_cyc;
+	struct gpio_callback cb;
+	struct k_timer debounce;
+};
+
+static struct button buttons[] = {
+	{ .spec = GPIO_DT_SPEC_GET(DT_ALIAS(button0), gpios), .evt = BTN_EVT_START },  /* SW0 */
+	{ .spec = GPIO_DT_SPEC_GET(DT_ALIAS(button1), gpios), .evt = BTN_EVT_STOP },   /* SW1 */
+	{ .spec = GPIO_DT_SPEC_GET(DT_ALIAS(button2), gpios), .evt = BTN_EVT_TOGGLE }, /* SW2 */
+	{ .spec = GPIO_DT_SPEC_GET(DT_ALIAS(button3), gpios), .evt = BTN_EVT_SW3,      /* SW3 */
+	  .hold_evt = BTN_EVT_SW3_HOLD, .hold_ms = CONFIG_APP_BTN_HOLD_MS },
+};
+#define NUM_BUTTONS ARRAY_SIZE(buttons)
+
+/* Connection table, indexed by bt_conn_index(); conn == NULL marks a free slot */
+struct link {
+	struct bt_conn *conn;
+	bool bonded;   /* Peer already had a bond when it connected */
+	bool pairing;  /* Numeric comparison in progress (LED3) */
+	/* Requests MITM security right after connect (forces phone UI) */
+	struct k_work_delayable security_work;
+};
 
-static struct bt_conn *current_conn;
+static struct link links[CONFIG_BT_MAX_CONN];
 
-static volatile bool start_pressed;
-static volatile bool stop_pressed;
-static volatile bool toggle_pressed;
+/* Guards the advertising, reconnect and link state below. ble_wq, the
+ * system workqueue items, the main loop and the shell all change it.
+ * The BT RX thread queues a record for ble_wq instead and only takes the
+ * lock when that queue is full (see "BLE event handling").
+ */
+static K_MUTEX_DEFINE(app_lock);
 
 static bool want_advertising;
 static bool adv_is_running;
@@ -70,8 +153,80 @@ static bool adv_is_running;
  */
 static bool use_rotating_rpa = true;
 
-/* Work item to request MITM security right after connect (forces phone UI) */
-static struct k_work_delayable security_work;
+/* PHY profile of the connectable set (SW3 cycles through them) */
+enum adv_phy {
+	ADV_PHY_1M_LEGACY,  /* Legacy PDUs on 1M: every phone sees it */
+	ADV_PHY_2M,         /* Extended, 2M secondary: shortest airtime per event */
+	ADV_PHY_CODED_S8,   /* Extended, LE Coded S8: long range */
+	ADV_PHY_COUNT,
+};
+
+static const char *const adv_phy_names[] = {
+	[ADV_PHY_1M_LEGACY] = "1M legacy",
+	[ADV_PHY_2M] = "2M secondary",
+	[ADV_PHY_CODED_S8] = "Coded S8",
+};
+
+static enum adv_phy adv_phy =
+	IS_ENABLED(CONFIG_APP_ADV_PHY_2M) ? ADV_PHY_2M :
+	IS_ENABLED(CONFIG_APP_ADV_PHY_CODED) ? ADV_PHY_CODED_S8 :
+	ADV_PHY_1M_LEGACY;
+
+/* Bonded-peer reconnect window that runs after a disconnect */
+enum reconn_phase {
+	RECONN_IDLE,
+	RECONN_DIRECTED,     /* High-duty directed to the peer that just left */
+	RECONN_ACCEPT_LIST,  /* Undirected, filter accept list of bonded peers */
+};
+
+static enum reconn_phase reconn_phase;
+
+#if defined(CONFIG_APP_RECONNECT)
+BUILD_ASSERT(CONFIG_APP_RECONNECT_FAL_PEERS <= CONFIG_BT_MAX_PAIRED,
+	     "More accept list peers than bond slots");
+#endif
+
+/* Work item that starts the next burst once the downtime has passed */
+static struct k_work_delayable adv_sched_work;
+static uint32_t adv_downtime_ms = CONFIG_APP_ADV_DOWNTIME_MIN_MS;
+static uint32_t adv_bursts_at_cap; /* Consecutive bursts at max downtime, no central */
+
+/* Work item that parks the device in System OFF after a long quiet spell */
+static struct k_work sysoff_work;
+
+/* Work item that writes changed app state to flash after a quiet period */
+static struct k_work_delayable settings_save_work;
+
+/* Work item that refreshes the periodic advertising status record */
+static struct k_work status_work;
+static struct bt_le_ext_adv *adv_status_set;
+
+/* Connection, pairing and advertising set events from the BT RX thread */
+enum ble_evt_type {
+	BLE_EVT_CONNECTED,
+	BLE_EVT_DISCONNECTED,
+	BLE_EVT_SECURITY,
+	BLE_EVT_PAIRING_CONFIRM,
+	BLE_EVT_PAIRING_CANCEL,
+	BLE_EVT_PAIRING_DONE,
+	BLE_EVT_PAIRING_FAILED,
+	BLE_EVT_ADV_SENT,
+	BLE_EVT_ADV_SCANNED,
+};
+
+struct ble_evt {
+	struct bt_conn *conn;       /* Reference held until handled; NULL for set events */
+	struct bt_le_ext_adv *adv;  /* ADV_SENT: the set that stopped */
+	uint32_t arg;               /* DISCONNECTED: cycle count, SECURITY: L3 latency (us),
+				     * ADV_SENT: events sent
+				     */
+	uint8_t type;
+	uint8_t code;               /* HCI error or reason, security level, bonded */
+	uint8_t err;                /* enum bt_security_err */
+};
+
+static void ble_evt_post(struct ble_evt *evt, struct bt_conn *conn);
+static void adv_sched_burst_done(void);
 
 static void addr_to_str(const bt_addr_le_t *addr, char *out, size_t out_len)
 {
@@ -81,179 +236,1874 @@ static void addr_to_str(const bt_addr_le_t *addr, char *out, size_t out_len)
 	bt_addr_le_to_str(addr, out, out_len);
 }
 
-static void leds_all_off(void)
+static struct link *link_of(struct bt_conn *conn)
+{
+	return &links[bt_conn_index(conn)];
+}
+
+static int link_count(void)
+{
+	int n = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		n += links[i].conn ? 1 : 0;
+	}
+
+	return n;
+}
+
+/* Connectable advertising needs a free connection object */
+static bool links_full(void)
+{
+	return link_count() >= CONFIG_BT_MAX_CONN;
+}
+
+/* Any connected peer, for actions that target a single link */
+static struct bt_conn *link_any(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i].conn) {
+			return links[i].conn;
+		}
+	}
+
+	return NULL;
+}
+
+static bool link_any_pairing(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i].pairing) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Refresh the status record once the set exists (CONFIG_APP_PER_ADV) */
+static void status_changed(void)
 {
-	for (int i = 0; i < NUM_LEDS; i++) {
-		gpio_pin_set_dt(&leds[i], 0);
+	if (adv_status_set) {
+		k_work_submit(&status_work);
 	}
 }
 
-/* LED0: advertising, LED1: connected, LED2: RPA mode, LED3: pairing indicator */
+/* LED0: advertising, LED1: any link up, LED2: RPA mode, LED3: pairing on any link */
 static void leds_update(void)
 {
-	gpio_pin_set_dt(&leds[0], adv_is_running ? 1 : 0);
-	gpio_pin_set_dt(&leds[1], current_conn ? 1 : 0);
-	gpio_pin_set_dt(&leds[2], use_rotating_rpa ? 1 : 0);
+	leds_set(0, adv_is_running || reconn_phase != RECONN_IDLE);
+	leds_set(1, link_count() > 0);
+	leds_set(2, use_rotating_rpa);
+	leds_set(3, link_any_pairing());
+
+	/* The status record carries the same state */
+	status_changed();
 }
 
 /* ---- Button ISRs ---- */
-static void isr_start(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+static void btn_post(const struct button *btn, enum btn_evt evt)
+{
+	struct btn_msg msg = { .evt = evt, .isr_cyc = btn->isr_cyc };
+
+	/* Never block in ISR context; a full queue just drops the press */
+	(void)k_msgq_put(&btn_evt_q, &msg, K_NO_WAIT);
+}
+
+static void btn_isr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+	struct button *btn = CONTAINER_OF(cb, struct button, cb);
+
+	ARG_UNUSED(dev); ARG_UNUSED(pins);
+
+	btn->isr_cyc = k_cycle_get_32();
+
+	/* Ignore the bounces; the timer decides whether this was a press */
+	gpio_pin_interrupt_configure_dt(&btn->spec, GPIO_INT_DISABLE);
+	k_timer_start(&btn->debounce, K_MSEC(CONFIG_APP_BTN_DEBOUNCE_MS), K_NO_WAIT);
+}
+
+static void btn_debounce_expiry(struct k_timer *timer)
+{
+	struct button *btn = CONTAINER_OF(timer, struct button, debounce);
+	bool pressed = gpio_pin_get_dt(&btn->spec) > 0;
+
+	if (!btn->hold_ms) {
+		if (pressed) {
+			btn_post(btn, btn->evt);
+		}
+	} else if (pressed) {
+		if (btn->held_ms < btn->hold_ms) {
+			btn->held_ms += CONFIG_APP_BTN_DEBOUNCE_MS;
+			if (btn->held_ms >= btn->hold_ms) {
+				btn_post(btn, btn->hold_evt);
+			}
+		}
+
+		/* Still down: poll again, interrupt stays off until release */
+		k_timer_start(&btn->debounce, K_MSEC(CONFIG_APP_BTN_DEBOUNCE_MS), K_NO_WAIT);
+		return;
+	} else {
+		if (btn->held_ms && btn->held_ms < btn->hold_ms) {
+			btn_post(btn, btn->evt);
+		}
+		btn->held_ms = 0;
+	}
+
+	gpio_pin_interrupt_configure_dt(&btn->spec, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+/* ---- Advertising ----
+ * Extended advertising sets run side by side:
+ *  - adv_conn_sets[]: one connectable set per address mode, each on its own
+ *                     identity (RPA on BT_ID_DEFAULT, stable address on a
+ *                     second identity from bt_id_create()). Only the set for
+ *                     the current mode runs; it is started once per burst and
+ *                     the controller ends it after the burst timeout.
+ *  - adv_beacon_set:  non-connectable beacon carrying the service UUID at a
+ *                     slow interval, also visible during the downtimes.
+ *  - adv_status_set:  with CONFIG_APP_PER_ADV, non-connectable set whose
+ *                     periodic train carries the status record.
+ */
+#define ADV_INT_MS(ms) ((ms) * 8 / 5) /* 0.625 ms units */
+
+enum adv_mode {
+	ADV_MODE_RPA,
+	ADV_MODE_IDENTITY,
+	ADV_MODE_COUNT,
+};
+
+#define ADV_MODE(rotating_rpa) ((rotating_rpa) ? ADV_MODE_RPA : ADV_MODE_IDENTITY)
+
+static struct bt_le_ext_adv *adv_conn_sets[ADV_MODE_COUNT];
+static enum adv_phy adv_conn_phy[ADV_MODE_COUNT]; /* PHY profile each set was created with */
+static uint8_t adv_mode_ids[ADV_MODE_COUNT] = { BT_ID_DEFAULT, BT_ID_DEFAULT };
+static enum adv_mode adv_conn_active;             /* Set the current burst runs on */
+static int64_t adv_burst_started_ms;
+static struct bt_le_ext_adv *adv_beacon_set;
+static bool beacon_is_running;
+static bool status_is_running;
+
+static const struct bt_le_ext_adv_cb adv_conn_cb;
+
+/* Runtime tunables (app.h). A change bumps adv_tune_gen; a connectable set
+ * built for an older generation is recreated the next time it starts.
+ */
+static struct app_adv_tune adv_tune = {
+	.int_min_ms = CONFIG_APP_ADV_INT_MIN_MS,
+	.int_max_ms = CONFIG_APP_ADV_INT_MAX_MS,
+	.burst_ms = CONFIG_APP_ADV_BURST_MS,
+	.growth_pct = CONFIG_APP_ADV_DOWNTIME_GROWTH_PCT,
+	.downtime_max_ms = CONFIG_APP_ADV_DOWNTIME_MAX_MS,
+};
+static uint32_t adv_tune_gen;
+static uint32_t adv_conn_gen[ADV_MODE_COUNT];
+
+static bool tx_power_set;    /* Controller default until the shell sets one */
+static int8_t tx_power_dbm;
+
+/* Battery profile (CONFIG_APP_BATTERY) scales the tuned interval and the
+ * downtime actually waited; the stored backoff position is not scaled.
+ */
+struct adv_batt_scale {
+	uint16_t interval_pct;
+	uint16_t downtime_pct;
+};
+
+static const struct adv_batt_scale adv_batt_scales[BATTERY_PROFILE_COUNT] = {
+	[BATTERY_FRESH] = { 100, 50 },
+	[BATTERY_NOMINAL] = { 100, 100 },
+	[BATTERY_LOW] = { 200, 200 },
+	[BATTERY_CRITICAL] = { 400, 400 },
+};
+
+static enum battery_profile batt_profile = BATTERY_NOMINAL;
+static bool battery_ok;
+
+/* Advertising interval for the current battery profile, clamped to the spec maximum */
+static uint16_t adv_batt_interval(uint16_t ms)
+{
+	return MIN((uint32_t)ms * adv_batt_scales[batt_profile].interval_pct / 100, 10240);
+}
+
+/* Local identity used for the given address mode */
+static uint8_t adv_id(bool rotating_rpa)
+{
+	return adv_mode_ids[ADV_MODE(rotating_rpa)];
+}
+
+static struct bt_le_adv_param adv_conn_param(enum adv_mode mode, enum adv_phy phy)
+{
+	struct bt_le_adv_param param = {
+		.id = adv_mode_ids[mode],
+		.sid = 0,
+		.secondary_max_skip = 0,
+		.options = BT_LE_ADV_OPT_CONN,
+		.interval_min = ADV_INT_MS(adv_batt_interval(adv_tune.int_min_ms)),
+		.interval_max = ADV_INT_MS(adv_batt_interval(adv_tune.int_max_ms)),
+		.peer = NULL,
+	};
+
+	if (mode == ADV_MODE_IDENTITY) {
+		param.options |= BT_LE_ADV_OPT_USE_IDENTITY;
+	}
+
+	switch (phy) {
+	case ADV_PHY_2M:
+		/* Primary channels stay 1M; AUX PDUs default to 2M */
+		param.options |= BT_LE_ADV_OPT_EXT_ADV;
+		break;
+	case ADV_PHY_CODED_S8:
+		param.options |= BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_CODED;
+#if defined(CONFIG_BT_EXT_ADV_CODING_SELECTION)
+		param.options |= BT_LE_ADV_OPT_REQUIRE_S8;
+#endif
+		break;
+	default:
+		break;
+	}
+
+	return param;
+}
+
+static int adv_conn_set_data(struct bt_le_ext_adv *set, enum adv_phy phy)
+{
+	if (phy == ADV_PHY_1M_LEGACY) {
+		return bt_le_ext_adv_set_data(set, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	}
+
+	return bt_le_ext_adv_set_data(set, ad_ext, ARRAY_SIZE(ad_ext), NULL, 0);
+}
+
+static int tx_power_write(uint8_t handle_type, uint16_t handle, int8_t dbm, int8_t *selected)
+{
+	struct bt_hci_cp_vs_write_tx_power_level *cp;
+	struct bt_hci_rp_vs_write_tx_power_level *rp;
+	struct net_buf *buf, *rsp = NULL;
+	int err;
+
+	/* bt_hci_cmd_send_sync() adds the command header */
+	buf = bt_hci_cmd_alloc(K_FOREVER);
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+	cp->handle_type = handle_type;
+	cp->tx_power_level = dbm;
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, buf, &rsp);
+	if (err) {
+		return err;
+	}
+
+	rp = (void *)rsp->data;
+	if (selected) {
+		*selected = rp->selected_tx_power;
+	}
+	net_buf_unref(rsp);
+	return 0;
+}
+
+static int adv_tx_power_apply(struct bt_le_ext_adv *set, int8_t *selected)
+{
+	uint8_t handle;
+	int err;
+
+	if (!set || !tx_power_set) {
+		return 0;
+	}
+
+	err = bt_hci_get_adv_handle(set, &handle);
+	if (err) {
+		return err;
+	}
+
+	return tx_power_write(BT_HCI_VS_LL_HANDLE_TYPE_ADV, handle, tx_power_dbm, selected);
+}
+
+/* Legacy and extended PDUs need different data, so a PHY change recreates the set */
+static int adv_conn_recreate(enum adv_mode mode, enum adv_phy phy)
+{
+	struct bt_le_adv_param param = adv_conn_param(mode, phy);
+	int err;
+
+	if (adv_conn_sets[mode]) {
+		err = bt_le_ext_adv_delete(adv_conn_sets[mode]);
+		if (err) {
+			LOG_ERR("Connectable set delete failed (err %d)", err);
+			return err;
+		}
+		adv_conn_sets[mode] = NULL;
+	}
+
+	err = bt_le_ext_adv_create(&param, &adv_conn_cb, &adv_conn_sets[mode]);
+	if (err) {
+		LOG_ERR("Connectable set create failed (%s, err %d)", adv_phy_names[phy], err);
+		return err;
+	}
+
+	err = adv_conn_set_data(adv_conn_sets[mode], phy);
+	if (err) {
+		LOG_ERR("Connectable set data failed (err %d)", err);
+		return err;
+	}
+
+	err = adv_tx_power_apply(adv_conn_sets[mode], NULL);
+	if (err) {
+		LOG_WRN("TX power not applied to new set (err %d)", err);
+	}
+
+	adv_conn_phy[mode] = phy;
+	adv_conn_gen[mode] = adv_tune_gen;
+	return 0;
+}
+
+/* Apply adv_phy, falling back to 1M legacy if the controller refuses it
+ * (e.g. Coded PHY on an nRF52832).
+ */
+static int adv_conn_apply_phy(enum adv_mode mode)
+{
+	int err = adv_conn_recreate(mode, adv_phy);
+
+	if (err && adv_phy != ADV_PHY_1M_LEGACY) {
+		LOG_WRN("%s not available, falling back to %s",
+			adv_phy_names[adv_phy], adv_phy_names[ADV_PHY_1M_LEGACY]);
+		adv_phy = ADV_PHY_1M_LEGACY;
+		err = adv_conn_recreate(mode, adv_phy);
+	}
+
+	return err;
+}
+
+/* Start the set for one mode; the controller stops it after timeout_ms */
+static int adv_conn_start_set(enum adv_mode mode, uint32_t timeout_ms)
 {
-	ARG_UNUSED(dev); ARG_UNUSED(cb); ARG_UNUSED(pins);
-	start_pressed = true;
+	int err;
+
+	if (adv_phy != adv_conn_phy[mode] || adv_tune_gen != adv_conn_gen[mode]) {
+		err = adv_conn_apply_phy(mode);
+		if (err) {
+			return err;
+		}
+	}
+
+	struct bt_le_ext_adv_start_param start = {
+		.timeout = MAX(timeout_ms / 10, 1),
+		.num_events = 0,
+	};
+
+	return bt_le_ext_adv_start(adv_conn_sets[mode], &start);
 }
 
-static void isr_stop(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+/* Pending "event -> advertising started" sample, armed by SW0 or a disconnect */
+static int adv_probe_hist = -1;
+static uint32_t adv_probe_cyc;
+
+static void adv_probe_arm(enum hist_id id, uint32_t start_cyc)
 {
-	ARG_UNUSED(dev); ARG_UNUSED(cb); ARG_UNUSED(pins);
-	stop_pressed = true;
+	adv_probe_cyc = start_cyc;
+	adv_probe_hist = id;
 }
 
-static void isr_toggle(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+static void adv_probe_done(void)
 {
-	ARG_UNUSED(dev); ARG_UNUSED(cb); ARG_UNUSED(pins);
-	toggle_pressed = true;
+	if (adv_probe_hist >= 0) {
+		hist_record_cyc(adv_probe_hist, adv_probe_cyc);
+		adv_probe_hist = -1;
+	}
 }
 
-/* ---- Advertising ---- */
 static int adv_stop(void)
 {
-	int err = bt_le_adv_stop();
+	uint32_t start_cyc = k_cycle_get_32();
+	int err = bt_le_ext_adv_stop(adv_conn_sets[adv_conn_active]);
 	if (err) {
-		LOG_WRN("bt_le_adv_stop err %d", err);
+		LOG_WRN("bt_le_ext_adv_stop err %d", err);
 	} else {
 		LOG_INF("Advertising stopped");
 	}
+	stats_adv_stopped();
 	adv_is_running = false;
 	leds_update();
-	return err;
+	hist_record_cyc(HIST_ADV_STOP, start_cyc);
+	return err;
+}
+
+static int adv_start(bool rotating_rpa)
+{
+	enum adv_mode mode = ADV_MODE(rotating_rpa);
+
+	if (links_full()) {
+		LOG_INF("All %d links in use; not starting advertising", CONFIG_BT_MAX_CONN);
+		return 0;
+	}
+
+	if (adv_is_running) {
+		LOG_INF("Already advertising; not restarting");
+		adv_probe_done();
+		return 0;
+	}
+
+	int err = adv_conn_start_set(mode, adv_tune.burst_ms);
+	if (err) {
+		if (err == -EALREADY) {
+			LOG_INF("Advertising already running (EALREADY)");
+			adv_is_running = true;
+			leds_update();
+			return 0;
+		}
+		LOG_ERR("Advertising start failed (err %d)", err);
+		return err;
+	}
+
+	adv_probe_done();
+	adv_conn_active = mode;
+	adv_burst_started_ms = k_uptime_get();
+	adv_is_running = true;
+	stats_adv_started();
+	LOG_INF("Advertising started (%s, %s), name=%s",
+		rotating_rpa ? "RPA rotating" : "Stable identity",
+		adv_phy_names[adv_phy], CONFIG_BT_DEVICE_NAME);
+
+	leds_update();
+	return 0;
+}
+
+/* Hand the running burst to the other mode's set for the rest of the burst.
+ * With two free connection objects the new set starts before the old one
+ * stops, so the radio never goes quiet; with a single one the old set has
+ * to release it first.
+ */
+static int adv_switch_mode(bool rotating_rpa)
+{
+	enum adv_mode mode = ADV_MODE(rotating_rpa);
+	enum adv_mode old = adv_conn_active;
+	int64_t elapsed = k_uptime_get() - adv_burst_started_ms;
+	uint32_t remaining = elapsed < adv_tune.burst_ms ?
+			     adv_tune.burst_ms - (uint32_t)elapsed : 10;
+	int err;
+
+	if (!adv_is_running || mode == old) {
+		return 0;
+	}
+
+	if (link_count() + 2 > CONFIG_BT_MAX_CONN) {
+		bt_le_ext_adv_stop(adv_conn_sets[old]);
+	}
+
+	err = adv_conn_start_set(mode, remaining);
+	if (err) {
+		LOG_ERR("Advertising switch failed (err %d)", err);
+		bt_le_ext_adv_stop(adv_conn_sets[old]);
+		stats_adv_stopped();
+		adv_is_running = false;
+		leds_update();
+
+		/* No set is left to report the end of the burst */
+		adv_sched_burst_done();
+		return err;
+	}
+
+	adv_conn_active = mode;
+	bt_le_ext_adv_stop(adv_conn_sets[old]);
+
+	LOG_INF("Advertising switched to %s (%u ms of burst left)",
+		rotating_rpa ? "RPA rotating" : "Stable identity", remaining);
+	return 0;
+}
+
+static int beacon_start(void)
+{
+	if (beacon_is_running) {
+		return 0;
+	}
+
+	struct bt_le_ext_adv_start_param start = {
+		.timeout = 0,
+		.num_events = CONFIG_APP_BEACON_MAX_EVENTS,
+	};
+
+	int err = bt_le_ext_adv_start(adv_beacon_set, &start);
+	if (err && err != -EALREADY) {
+		LOG_ERR("Beacon start failed (err %d)", err);
+		return err;
+	}
+
+	beacon_is_running = true;
+	LOG_INF("Beacon started (%d ms interval)", CONFIG_APP_BEACON_INT_MS);
+	return 0;
+}
+
+static void beacon_stop(void)
+{
+	int err = bt_le_ext_adv_stop(adv_beacon_set);
+	if (err) {
+		LOG_WRN("Beacon stop err %d", err);
+	}
+	beacon_is_running = false;
+}
+
+static int beacon_set_data(void)
+{
+	/* A scannable beacon needs scan response data; the name is what a phone shows */
+	if (IS_ENABLED(CONFIG_APP_SCAN_REQ_RESET)) {
+		return bt_le_ext_adv_set_data(adv_beacon_set, ad, ARRAY_SIZE(ad),
+					      sd, ARRAY_SIZE(sd));
+	}
+
+	return bt_le_ext_adv_set_data(adv_beacon_set, ad, ARRAY_SIZE(ad), NULL, 0);
+}
+
+/* Growth steps the next downtime is above the minimum */
+static uint8_t adv_backoff_level(void)
+{
+	uint32_t ms = CONFIG_APP_ADV_DOWNTIME_MIN_MS;
+	uint8_t level = 0;
+
+	if (adv_tune.growth_pct <= 100) {
+		return 0;
+	}
+
+	while (ms < adv_downtime_ms && level < UINT8_MAX) {
+		ms = (uint64_t)ms * adv_tune.growth_pct / 100;
+		level++;
+	}
+
+	return level;
+}
+
+/* Rewrite the manufacturer data of every set that carries ad[] if a field
+ * changed. Runs at the start of each burst, so no timer of its own; the sets
+ * keep advertising and their timing is not reset.
+ */
+static void adv_mfg_refresh(void)
+{
+	uint8_t fields[ADV_MFG_FIELDS] = {
+		MIN(k_uptime_get() / (3600 * MSEC_PER_SEC), UINT8_MAX),
+		adv_backoff_level(),
+		battery_pct,
+	};
+	int err = 0;
+
+	if (memcmp(&adv_mfg[ADV_MFG_SEQ + 1], fields, sizeof(fields)) == 0) {
+		return;
+	}
+
+	memcpy(&adv_mfg[ADV_MFG_SEQ + 1], fields, sizeof(fields));
+	adv_mfg[ADV_MFG_SEQ]++;
+
+	for (int mode = 0; mode < ADV_MODE_COUNT && !err; mode++) {
+		if (adv_conn_sets[mode]) {
+			err = adv_conn_set_data(adv_conn_sets[mode], adv_conn_phy[mode]);
+		}
+	}
+
+	if (!err && adv_beacon_set) {
+		err = beacon_set_data();
+	}
+
+	if (err) {
+		LOG_WRN("Manufacturer data update failed (err %d)", err);
+	}
+}
+
+/* ---- Periodic status broadcast ----
+ * A scanner that only needs the device state syncs to the periodic train of
+ * adv_status_set instead of connecting. The record is manufacturer data,
+ * little-endian, rewritten in place only when a field changes:
+ *   company id (0xFFFF, testing), version, flags (bit 0 advertising wanted,
+ *   bit 1 RPA mode, bit 2 pairing, bits 4-5 links up), PHY profile,
+ *   battery % (0xFF = unknown), next downtime (s), connections, adv starts,
+ *   pairing ok, pairing failed (uint16 counters wrap).
+ */
+#define PER_ADV_INT_MS(ms) ((ms) * 4 / 5) /* 1.25 ms units */
+
+#define STATUS_VERSION    1
+#define STATUS_LEN        18
+
+static uint8_t status_rec[STATUS_LEN];
+
+static void status_encode(uint8_t *buf)
+{
+	struct stats_snapshot snap;
+	uint8_t flags = (want_advertising ? BIT(0) : 0) |
+			(use_rotating_rpa ? BIT(1) : 0) |
+			(link_any_pairing() ? BIT(2) : 0) |
+			(MIN(link_count(), 3) << 4);
+
+	stats_get(&snap);
+
+	sys_put_le16(APP_COMPANY_ID, &buf[0]);
+	buf[2] = STATUS_VERSION;
+	buf[3] = flags;
+	buf[4] = adv_phy;
+	buf[5] = battery_pct;
+	sys_put_le16(MIN(adv_downtime_ms / MSEC_PER_SEC, UINT16_MAX), &buf[6]);
+	sys_put_le16(snap.connections, &buf[8]);
+	sys_put_le16(snap.adv_starts, &buf[10]);
+	sys_put_le16(snap.pairing_ok, &buf[12]);
+	sys_put_le16(snap.pairing_failed, &buf[14]);
+	sys_put_le16(0, &buf[16]); /* Reserved */
+}
+
+static void status_refresh(void)
+{
+	uint8_t rec[STATUS_LEN];
+
+	if (!adv_status_set) {
+		return;
+	}
+
+	status_encode(rec);
+	if (memcmp(rec, status_rec, sizeof(rec)) == 0) {
+		return;
+	}
+
+	memcpy(status_rec, rec, sizeof(rec));
+
+	const struct bt_data per_ad[] = {
+		BT_DATA(BT_DATA_MANUFACTURER_DATA, status_rec, sizeof(status_rec)),
+	};
+
+	int err = bt_le_per_adv_set_data(adv_status_set, per_ad, ARRAY_SIZE(per_ad));
+	if (err) {
+		LOG_WRN("Status record update failed (err %d)", err);
+		/* Retry on the next change */
+		memset(status_rec, 0, sizeof(status_rec));
+	}
+}
+
+static void status_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	status_refresh();
+	k_mutex_unlock(&app_lock);
+}
+
+static int status_start(void)
+{
+	int err;
+
+	if (!adv_status_set || status_is_running) {
+		return 0;
+	}
+
+	err = bt_le_per_adv_start(adv_status_set);
+	if (err && err != -EALREADY) {
+		LOG_ERR("Periodic advertising start failed (err %d)", err);
+		return err;
+	}
+
+	/* Scanners find the train through the SyncInfo of this set */
+	err = bt_le_ext_adv_start(adv_status_set, BT_LE_EXT_ADV_START_DEFAULT);
+	if (err && err != -EALREADY) {
+		LOG_ERR("Status set start failed (err %d)", err);
+		bt_le_per_adv_stop(adv_status_set);
+		return err;
+	}
+
+	status_is_running = true;
+	LOG_INF("Status broadcast started (%d ms periodic interval)",
+		CONFIG_APP_PER_ADV_INT_MS);
+	return 0;
+}
+
+static void status_stop(void)
+{
+	if (!status_is_running) {
+		return;
+	}
+
+	bt_le_ext_adv_stop(adv_status_set);
+	bt_le_per_adv_stop(adv_status_set);
+	status_is_running = false;
+}
+
+static int status_init(void)
+{
+	struct bt_le_adv_param param = {
+		.id = BT_ID_DEFAULT,
+		.sid = 2,
+		.secondary_max_skip = 0,
+		.options = BT_LE_ADV_OPT_EXT_ADV,
+		.interval_min = ADV_INT_MS(CONFIG_APP_PER_ADV_INT_MS),
+		.interval_max = ADV_INT_MS(CONFIG_APP_PER_ADV_INT_MS * 6 / 5),
+		.peer = NULL,
+	};
+	struct bt_le_per_adv_param per_param = {
+		.interval_min = PER_ADV_INT_MS(CONFIG_APP_PER_ADV_INT_MS),
+		.interval_max = PER_ADV_INT_MS(CONFIG_APP_PER_ADV_INT_MS),
+		.options = BT_LE_PER_ADV_OPT_NONE,
+	};
+	int err;
+
+	err = bt_le_ext_adv_create(&param, NULL, &adv_status_set);
+	if (err) {
+		LOG_ERR("Status set create failed (err %d)", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_set_param(adv_status_set, &per_param);
+	if (err) {
+		LOG_ERR("Periodic advertising params failed (err %d)", err);
+		return err;
+	}
+
+	k_work_submit(&status_work);
+	return 0;
+}
+
+/* ---- Battery profiles ----
+ * The supply is sampled at the start of each burst, when the CPU is awake
+ * for the radio anyway. The reading feeds the manufacturer data and the
+ * status record, and the profile scales the next set parameters and
+ * downtimes. Critical also darkens the LEDs and stops the log backends.
+ */
+#if defined(CONFIG_LOG)
+static uint32_t log_backends_muted; /* Backends battery_logging() deactivated */
+
+static void battery_logging(bool on)
+{
+	for (int i = 0; i < MIN(log_backend_count_get(), 32); i++) {
+		const struct log_backend *backend = log_backend_get(i);
+
+		if (!on && log_backend_is_active(backend)) {
+			log_backend_disable(backend);
+			log_backends_muted |= BIT(i);
+		} else if (on && (log_backends_muted & BIT(i))) {
+			log_backend_enable(backend, backend->cb->ctx, CONFIG_LOG_MAX_LEVEL);
+			log_backends_muted &= ~BIT(i);
+		}
+	}
+}
+#else
+static void battery_logging(bool on)
+{
+	ARG_UNUSED(on);
+}
+#endif
+
+static void battery_update(void)
+{
+	uint16_t mv;
+	uint8_t pct;
+
+	/* battery.c is only built with CONFIG_APP_BATTERY; the constant check
+	 * drops the calls below at any optimization level
+	 */
+	if (!IS_ENABLED(CONFIG_APP_BATTERY) || !battery_ok) {
+		return;
+	}
+
+	int err = battery_measure(&mv, &pct);
+	if (err) {
+		LOG_WRN("Battery read failed (err %d)", err);
+		return;
+	}
+
+	battery_pct = pct;
+
+	enum battery_profile profile = battery_profile_select(pct, batt_profile);
+
+	if (profile == batt_profile) {
+		return;
+	}
+
+	LOG_INF("Battery %u mV (%u%%): profile %s -> %s", mv, pct,
+		battery_profile_name(batt_profile), battery_profile_name(profile));
+
+	if (profile == BATTERY_CRITICAL) {
+		leds_mute(true);
+		battery_logging(false);
+	} else if (batt_profile == BATTERY_CRITICAL) {
+		leds_mute(false);
+		battery_logging(true);
+	}
+
+	batt_profile = profile;
+	adv_tune_gen++;
+}
+
+/* ---- Persistent app state ----
+ * use_rotating_rpa, want_advertising and the backoff position live under
+ * "app/" in the same settings backend as the bonds. Changes only schedule
+ * settings_save_work, so a burst of SW2 toggles costs one flash write, and
+ * keys whose value matches what is already stored are not rewritten.
+ */
+static struct {
+	bool rpa;
+	bool want_adv;
+	uint32_t downtime_ms;
+} app_saved = {
+	.rpa = true,
+	.want_adv = false,
+	.downtime_ms = CONFIG_APP_ADV_DOWNTIME_MIN_MS,
+};
+
+static int app_settings_read(size_t len, settings_read_cb read_cb, void *cb_arg,
+			     void *out, size_t out_len)
+{
+	if (len != out_len) {
+		return -EINVAL;
+	}
+
+	ssize_t rc = read_cb(cb_arg, out, out_len);
+
+	return rc < 0 ? (int)rc : 0;
+}
+
+static int app_settings_set(const char *name, size_t len,
+			    settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	int err;
+
+	if (settings_name_steq(name, "rpa", &next) && !next) {
+		err = app_settings_read(len, read_cb, cb_arg, &app_saved.rpa,
+					sizeof(app_saved.rpa));
+		use_rotating_rpa = app_saved.rpa;
+		return err;
+	}
+
+	if (settings_name_steq(name, "want_adv", &next) && !next) {
+		err = app_settings_read(len, read_cb, cb_arg, &app_saved.want_adv,
+					sizeof(app_saved.want_adv));
+		want_advertising = app_saved.want_adv;
+		return err;
+	}
+
+	if (settings_name_steq(name, "downtime", &next) && !next) {
+		err = app_settings_read(len, read_cb, cb_arg, &app_saved.downtime_ms,
+					sizeof(app_saved.downtime_ms));
+		adv_downtime_ms = CLAMP(app_saved.downtime_ms, CONFIG_APP_ADV_DOWNTIME_MIN_MS,
+					CONFIG_APP_ADV_DOWNTIME_MAX_MS);
+		return err;
+	}
+
+	return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app, "app", NULL, app_settings_set, NULL, NULL);
+
+static void settings_save_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	uint32_t start_cyc = k_cycle_get_32();
+	int err = 0;
+
+	/* Copy under the lock; the flash writes happen outside it */
+	k_mutex_lock(&app_lock, K_FOREVER);
+	bool rpa = use_rotating_rpa;
+	bool want_adv = want_advertising;
+	uint32_t downtime_ms = adv_downtime_ms;
+	k_mutex_unlock(&app_lock);
+
+	if (rpa != app_saved.rpa) {
+		app_saved.rpa = rpa;
+		err |= settings_save_one("app/rpa", &app_saved.rpa, sizeof(app_saved.rpa));
+	}
+
+	if (want_adv != app_saved.want_adv) {
+		app_saved.want_adv = want_adv;
+		err |= settings_save_one("app/want_adv", &app_saved.want_adv,
+					 sizeof(app_saved.want_adv));
+	}
+
+	if (downtime_ms != app_saved.downtime_ms) {
+		app_saved.downtime_ms = downtime_ms;
+		err |= settings_save_one("app/downtime", &app_saved.downtime_ms,
+					 sizeof(app_saved.downtime_ms));
+	}
+
+	if (err) {
+		LOG_WRN("App settings save failed");
+	}
+
+	hist_record_cyc(HIST_SETTINGS_SAVE, start_cyc);
+}
+
+/* Coalesce: the first change opens the window, later ones ride along */
+static void app_state_changed(void)
+{
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		k_work_schedule(&settings_save_work, K_MSEC(CONFIG_APP_SETTINGS_SAVE_DELAY_MS));
+	}
+}
+
+/* ---- Advertising backoff scheduler ----
+ * Each burst lasts adv_tune.burst_ms (enforced by the controller), then the
+ * connectable set stays quiet for adv_downtime_ms. The downtime grows by
+ * adv_tune.growth_pct after every burst up to adv_tune.downtime_max_ms; the
+ * boot values are CONFIG_APP_ADV_*. A button press or connection resets it.
+ *
+ * Devices that power up together would otherwise keep their bursts in
+ * lockstep, so each wait is spread by +/- CONFIG_APP_ADV_JITTER_PCT and the
+ * first burst after boot by up to CONFIG_APP_ADV_BOOT_SPREAD_MS. The PRNG is
+ * seeded from the identity address: different per device, but the same
+ * sequence on every boot of one device, which keeps field logs comparable.
+ */
+static uint32_t jitter_state = 1;
+
+static void adv_jitter_seed(const bt_addr_le_t *addr)
+{
+	uint32_t h = 2166136261U; /* FNV-1a */
+
+	for (int i = 0; i < sizeof(addr->a.val); i++) {
+		h = (h ^ addr->a.val[i]) * 16777619U;
+	}
+
+	jitter_state = h ? h : 1;
+}
+
+static uint32_t adv_jitter_next(void)
+{
+	uint32_t x = jitter_state;
+
+	/* xorshift32 */
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	jitter_state = x;
+	return x;
+}
+
+/* ms spread uniformly over [ms - pct, ms + pct] */
+static uint32_t adv_jittered(uint32_t ms)
+{
+	uint32_t span = (uint64_t)ms * CONFIG_APP_ADV_JITTER_PCT / 100;
+
+	if (!span) {
+		return ms;
+	}
+
+	return ms - span + adv_jitter_next() % (2 * span + 1);
+}
+
+static void adv_burst_start(void)
+{
+	if (!want_advertising || links_full() || reconn_phase != RECONN_IDLE) {
+		return;
+	}
+
+	battery_update();
+	adv_mfg_refresh();
+
+	/* Beacon may have used up its event budget since the last burst */
+	beacon_start();
+	status_start();
+
+	/* A set that failed to start never reports an end; count the burst as
+	 * done so the backoff keeps going
+	 */
+	if (adv_start(use_rotating_rpa)) {
+		adv_sched_burst_done();
+	}
+}
+
+static void adv_sched_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	adv_burst_start();
+	k_mutex_unlock(&app_lock);
+}
+
+/* Controller finished a burst: schedule the next one and grow the downtime */
+static void adv_sched_burst_done(void)
+{
+	if (!want_advertising || links_full()) {
+		return;
+	}
+
+	/* Only a device nobody is connected to counts towards System OFF */
+	if (adv_downtime_ms >= adv_tune.downtime_max_ms && !link_count()) {
+		adv_bursts_at_cap++;
+	}
+
+	if (IS_ENABLED(CONFIG_APP_SYSOFF) && adv_bursts_at_cap >= CONFIG_APP_SYSOFF_IDLE_BURSTS) {
+		LOG_INF("Backoff: %u bursts at max downtime without a central",
+			adv_bursts_at_cap);
+		k_work_submit(&sysoff_work);
+		return;
+	}
+
+	uint32_t wait_ms = adv_jittered(MIN((uint64_t)adv_downtime_ms *
+					    adv_batt_scales[batt_profile].downtime_pct / 100,
+					    3600000));
+
+	LOG_INF("Backoff: next burst in %u ms", wait_ms);
+	k_work_schedule(&adv_sched_work, K_MSEC(wait_ms));
+
+	uint64_t next = (uint64_t)adv_downtime_ms * adv_tune.growth_pct / 100;
+	uint32_t downtime_ms = MIN(next, adv_tune.downtime_max_ms);
+
+	/* At the cap nothing changes, so no save work wakes up after the burst */
+	if (downtime_ms != adv_downtime_ms) {
+		adv_downtime_ms = downtime_ms;
+		app_state_changed();
+	}
+}
+
+/* Start a burst now and restart the downtime sequence from the minimum */
+static void adv_sched_reset(void)
+{
+	if (adv_downtime_ms != CONFIG_APP_ADV_DOWNTIME_MIN_MS) {
+		adv_downtime_ms = CONFIG_APP_ADV_DOWNTIME_MIN_MS;
+		app_state_changed();
+	}
+	adv_bursts_at_cap = 0;
+	k_work_reschedule(&adv_sched_work, K_NO_WAIT);
+}
+
+/* First burst after boot, keeping the downtime restored from settings */
+static void adv_sched_resume(void)
+{
+	uint32_t phase_ms = 0;
+
+#if CONFIG_APP_ADV_BOOT_SPREAD_MS > 0
+	phase_ms = adv_jitter_next() % CONFIG_APP_ADV_BOOT_SPREAD_MS;
+	LOG_INF("Boot phase: first burst in %u ms", phase_ms);
+#endif
+
+	k_work_reschedule(&adv_sched_work, K_MSEC(phase_ms));
+}
+
+/* A known central is scanning: back to the minimum downtime, and end the
+ * current downtime now instead of letting it run out.
+ */
+static void adv_sched_nearby(void)
+{
+	if (!want_advertising || links_full() || reconn_phase != RECONN_IDLE) {
+		return;
+	}
+
+	if (adv_is_running) {
+		if (adv_downtime_ms != CONFIG_APP_ADV_DOWNTIME_MIN_MS) {
+			adv_downtime_ms = CONFIG_APP_ADV_DOWNTIME_MIN_MS;
+			adv_bursts_at_cap = 0;
+			app_state_changed();
+		}
+		return;
+	}
+
+	LOG_INF("Central scanning nearby -> downtime cut to %d ms",
+		CONFIG_APP_ADV_DOWNTIME_MIN_MS);
+	adv_sched_reset();
+}
+
+static void adv_sched_cancel(void)
+{
+	k_work_cancel_delayable(&adv_sched_work);
+	adv_bursts_at_cap = 0;
+}
+
+/* ---- Advertising sets ----
+ * The set callbacks run on the BT RX thread and queue a record like the
+ * connection callbacks; the handlers below run on ble_wq.
+ */
+static void adv_conn_sent(struct bt_le_ext_adv *adv, uint32_t num_sent)
+{
+	/* A set that was just handed over may still time out on its own */
+	if (adv != adv_conn_sets[adv_conn_active]) {
+		return;
+	}
+
+	LOG_INF("Burst ended (%u events)", num_sent);
+	stats_adv_stopped();
+	adv_is_running = false;
+	leds_update();
+	adv_sched_burst_done();
+}
+
+static void adv_beacon_sent(uint32_t num_sent)
+{
+	LOG_INF("Beacon event budget used (%u events)", num_sent);
+	beacon_is_running = false;
+}
+
+static bool scanner_is_bonded(const bt_addr_le_t *addr)
+{
+	return bonds_is_bonded_any(addr);
+}
+
+/* A scan request record is queued; later requests until it is handled add nothing */
+static atomic_t scan_req_pending;
+
+/* BT RX thread, every set */
+static void adv_sent(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info)
+{
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_ADV_SENT, .adv = adv,
+					.arg = info->num_sent }, NULL);
+}
+
+/* Scan request on the beacon, BT RX thread. Resolved by the controller, so
+ * a bonded phone shows up with its identity address even while it uses RPAs.
+ */
+static void adv_beacon_scanned(struct bt_le_ext_adv *adv,
+			       struct bt_le_ext_adv_scanned_info *info)
+{
+	ARG_UNUSED(adv);
+
+	if ((IS_ENABLED(CONFIG_APP_SCAN_REQ_ANY) || scanner_is_bonded(info->addr)) &&
+	    atomic_cas(&scan_req_pending, 0, 1)) {
+		ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_ADV_SCANNED }, NULL);
+	}
+}
+
+static const struct bt_le_ext_adv_cb adv_conn_cb = {
+	.sent = adv_sent,
+};
+
+static const struct bt_le_ext_adv_cb adv_beacon_cb = {
+	.sent = adv_sent,
+	.scanned = adv_beacon_scanned,
+};
+
+/* ---- Bonded-peer reconnect ----
+ * Before the open backoff schedule resumes after a disconnect:
+ *  1. High-duty directed advertising to the peer that just left, if bonded.
+ *     The controller ends it after ~1.28 s.
+ *  2. Undirected advertising for CONFIG_APP_RECONNECT_FAL_MS, with the filter
+ *     accept list holding the CONFIG_APP_RECONNECT_FAL_PEERS most recently
+ *     seen bonded peers (bonds.c), so the controller ignores scan and connect
+ *     requests from anyone else.
+ * Both run on adv_reconn_set; reconn_work advances to the next phase.
+ */
+static struct bt_le_ext_adv *adv_reconn_set;
+static struct k_work reconn_work;
+static bt_addr_le_t reconn_peer;
+static bool reconn_have_peer;
+static uint8_t reconn_id;         /* Identity the peer that left was connected on */
+static bool reconn_rotating_rpa;  /* Address mode of reconn_id */
+static atomic_t reconn_on_air; /* Set started and not yet ended or connected */
+
+static int reconn_start_phase(enum reconn_phase phase)
+{
+	struct bt_le_adv_param param = {
+		.id = reconn_id,
+		.sid = 0,
+		.secondary_max_skip = 0,
+		.options = BT_LE_ADV_OPT_CONN,
+		.interval_min = BT_GAP_ADV_FAST_INT_MIN_1,
+		.interval_max = BT_GAP_ADV_FAST_INT_MAX_1,
+		.peer = NULL,
+	};
+	struct bt_le_ext_adv_start_param start = {
+		.timeout = BT_GAP_ADV_HIGH_DUTY_CYCLE_MAX_TIMEOUT,
+		.num_events = 0,
+	};
+	bt_addr_le_t fal[CONFIG_APP_RECONNECT_FAL_PEERS];
+	size_t count = 0;
+	int err;
+
+	if (!reconn_rotating_rpa) {
+		param.options |= BT_LE_ADV_OPT_USE_IDENTITY;
+	}
+
+	if (phase == RECONN_DIRECTED) {
+		/* High duty: interval is fixed by the controller; the spec caps
+		 * the duration at 1.28 s and a non-zero timeout makes the host
+		 * report the end through the set's sent callback.
+		 */
+		param.peer = &reconn_peer;
+
+		/* Directed PDUs carry no data, and the controller rejects the
+		 * parameters while the accept-list phase's AD is still loaded
+		 */
+		err = bt_le_ext_adv_set_data(adv_reconn_set, NULL, 0, NULL, 0);
+		if (err) {
+			LOG_ERR("Reconnect data clear failed (err %d)", err);
+			return err;
+		}
+	} else {
+		/* The accept list cannot change while a set is using it */
+		bt_le_ext_adv_stop(adv_reconn_set);
+		bt_le_filter_accept_list_clear();
+		count = bonds_recent(param.id, fal, ARRAY_SIZE(fal));
+		if (count == 0) {
+			return -ENOENT;
+		}
+
+		for (int i = 0; i < count; i++) {
+			err = bt_le_filter_accept_list_add(&fal[i]);
+			if (err) {
+				LOG_WRN("Accept list add failed (err %d)", err);
+			}
+		}
+
+		param.options |= BT_LE_ADV_OPT_FILTER_CONN | BT_LE_ADV_OPT_FILTER_SCAN_REQ;
+		start.timeout = CONFIG_APP_RECONNECT_FAL_MS / 10;
+	}
+
+	err = bt_le_ext_adv_update_param(adv_reconn_set, &param);
+	if (err) {
+		LOG_ERR("Reconnect param update failed (err %d)", err);
+		return err;
+	}
+
+	if (phase == RECONN_ACCEPT_LIST) {
+		err = bt_le_ext_adv_set_data(adv_reconn_set, ad, ARRAY_SIZE(ad),
+					     sd, ARRAY_SIZE(sd));
+		if (err) {
+			LOG_ERR("Reconnect set data failed (err %d)", err);
+			return err;
+		}
+	}
+
+	err = bt_le_ext_adv_start(adv_reconn_set, &start);
+	if (err) {
+		LOG_ERR("Reconnect advertising start failed (err %d)", err);
+		return err;
+	}
+
+	adv_probe_done();
+	reconn_phase = phase;
+	atomic_set(&reconn_on_air, 1);
+	stats_adv_started();
+	leds_update();
+
+	if (phase == RECONN_DIRECTED) {
+		char peer[BT_ADDR_LE_STR_LEN] = {0};
+
+		addr_to_str(&reconn_peer, peer, sizeof(peer));
+		LOG_INF("Reconnect: directed advertising to %s", peer);
+	} else {
+		LOG_INF("Reconnect: accept-list advertising (%zu bonded peers)", count);
+	}
+	return 0;
+}
+
+/* Start the phase after the one that just ended */
+static void reconn_next(void)
+{
+	if (!want_advertising || links_full()) {
+		reconn_phase = RECONN_IDLE;
+		leds_update();
+		return;
+	}
+
+	switch (reconn_phase) {
+	case RECONN_IDLE:
+		if (reconn_have_peer && reconn_start_phase(RECONN_DIRECTED) == 0) {
+			return;
+		}
+		__fallthrough;
+	case RECONN_DIRECTED:
+		if (reconn_start_phase(RECONN_ACCEPT_LIST) == 0) {
+			return;
+		}
+		__fallthrough;
+	default:
+		break;
+	}
+
+	reconn_phase = RECONN_IDLE;
+	leds_update();
+	LOG_INF("Reconnect window over; resuming open advertising");
+	adv_sched_reset();
+}
+
+static void reconn_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	reconn_next();
+	k_mutex_unlock(&app_lock);
+}
+
+/* The window runs on the identity the peer was bonded on, which need not be
+ * the current mode's after a switch
+ */
+static void reconn_begin(uint8_t id, const bt_addr_le_t *peer)
+{
+	reconn_id = id;
+	reconn_rotating_rpa = adv_id(true) != adv_id(false) ? id == adv_id(true) :
+			      use_rotating_rpa;
+
+	reconn_have_peer = bonds_is_bonded(id, peer);
+	if (reconn_have_peer) {
+		bt_addr_le_copy(&reconn_peer, peer);
+	}
+
+	/* Other links may have kept open advertising going; the window comes first */
+	adv_sched_cancel();
+	if (adv_is_running) {
+		adv_stop();
+	}
+
+	reconn_phase = RECONN_IDLE;
+	k_work_submit(&reconn_work);
+}
+
+static void reconn_cancel(void)
+{
+	k_work_cancel(&reconn_work);
+	atomic_clear(&reconn_on_air);
+
+	if (reconn_phase != RECONN_IDLE) {
+		bt_le_ext_adv_stop(adv_reconn_set);
+		stats_adv_stopped();
+		reconn_phase = RECONN_IDLE;
+		leds_update();
+	}
+}
+
+/* The host reports the end of a timed-out directed set both through
+ * connected(BT_HCI_ERR_ADV_TIMEOUT) and the set's sent callback; advance once.
+ */
+static void reconn_set_ended(void)
+{
+	if (atomic_cas(&reconn_on_air, 1, 0)) {
+		stats_adv_stopped();
+		k_work_submit(&reconn_work);
+	}
+}
+
+static const struct bt_le_ext_adv_cb adv_reconn_cb = {
+	.sent = adv_sent,
+};
+
+/* ---- System OFF ----
+ * Once the scheduler has spent CONFIG_APP_SYSOFF_IDLE_BURSTS bursts at the max
+ * downtime with no central, even System ON idle costs too much. Persist the
+ * state, arm the buttons as wake sources (GPIO sense) and power off. A button
+ * press resets the chip; main() then resumes the scheduler from settings.
+ */
+static void sysoff_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	/* Held into sys_poweroff() so nothing restarts advertising meanwhile */
+	k_mutex_lock(&app_lock, K_FOREVER);
+
+	if (link_count() || !want_advertising) {
+		k_mutex_unlock(&app_lock);
+		return;
+	}
+
+	/* Flush now instead of waiting for the coalescing window */
+	k_work_cancel_delayable(&settings_save_work);
+	settings_save_work_fn(NULL);
+	bonds_flush();
+
+	adv_sched_cancel();
+	reconn_cancel();
+	beacon_stop();
+	status_stop();
+	if (adv_is_running) {
+		adv_stop();
+	}
+	leds_all_off();
+
+	for (int i = 0; i < NUM_BUTTONS; i++) {
+		k_timer_stop(&buttons[i].debounce);
+		gpio_pin_interrupt_configure_dt(&buttons[i].spec, GPIO_INT_LEVEL_ACTIVE);
+	}
+
+	LOG_INF("Entering System OFF; press any button to wake");
+	LOG_PANIC();
+
+	sys_poweroff();
+}
+
+/* Stable-identity mode advertises from its own identity; it is created once
+ * and then restored from settings like the default one.
+ */
+static int adv_identity_init(void)
+{
+	bt_addr_le_t addrs[CONFIG_BT_ID_MAX];
+	size_t count = ARRAY_SIZE(addrs);
+	int id;
+
+	bt_id_get(addrs, &count);
+	if (count > 1) {
+		id = 1;
+	} else {
+		id = bt_id_create(NULL, NULL);
+		if (id < 0) {
+			LOG_ERR("Identity create failed (err %d)", id);
+			return id;
+		}
+		bt_id_get(addrs, &count);
+	}
+
+	adv_mode_ids[ADV_MODE_IDENTITY] = id;
+	adv_jitter_seed(&addrs[BT_ID_DEFAULT]);
+
+	char addr[BT_ADDR_LE_STR_LEN] = {0};
+
+	addr_to_str(&addrs[id], addr, sizeof(addr));
+	LOG_INF("Stable identity %u: %s", id, addr);
+	return 0;
+}
+
+static int adv_init(void)
+{
+	struct bt_le_adv_param beacon_param = {
+		.id = BT_ID_DEFAULT,
+		.sid = 1,
+		.secondary_max_skip = 0,
+		.options = IS_ENABLED(CONFIG_APP_SCAN_REQ_RESET) ?
+			   BT_LE_ADV_OPT_SCANNABLE | BT_LE_ADV_OPT_NOTIFY_SCAN_REQ :
+			   BT_LE_ADV_OPT_NONE,
+		.interval_min = ADV_INT_MS(CONFIG_APP_BEACON_INT_MS),
+		.interval_max = ADV_INT_MS(CONFIG_APP_BEACON_INT_MS * 6 / 5),
+		.peer = NULL,
+	};
+	int err;
+
+	err = adv_identity_init();
+	if (err) {
+		return err;
+	}
+
+	for (int mode = 0; mode < ADV_MODE_COUNT; mode++) {
+		err = adv_conn_apply_phy(mode);
+		if (err) {
+			return err;
+		}
+	}
+
+	err = bt_le_ext_adv_create(&beacon_param, &adv_beacon_cb, &adv_beacon_set);
+	if (err) {
+		LOG_ERR("Beacon set create failed (err %d)", err);
+		return err;
+	}
+
+	err = beacon_set_data();
+	if (err) {
+		LOG_ERR("Beacon set data failed (err %d)", err);
+		return err;
+	}
+
+	k_work_init(&reconn_work, reconn_work_fn);
+
+	if (IS_ENABLED(CONFIG_APP_RECONNECT)) {
+		struct bt_le_adv_param reconn_param = adv_conn_param(ADV_MODE_RPA,
+								     ADV_PHY_1M_LEGACY);
+
+		err = bt_le_ext_adv_create(&reconn_param, &adv_reconn_cb, &adv_reconn_set);
+		if (err) {
+			LOG_ERR("Reconnect set create failed (err %d)", err);
+			return err;
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_APP_PER_ADV)) {
+		err = status_init();
+		if (err) {
+			return err;
+		}
+	}
+
+	LOG_INF("Advertising sets ready (connectable x2 + beacon%s%s)",
+		IS_ENABLED(CONFIG_APP_RECONNECT) ? " + reconnect" : "",
+		IS_ENABLED(CONFIG_APP_PER_ADV) ? " + status" : "");
+	return 0;
+}
+
+/* ---- Security request work ---- */
+static void security_request(struct link *link)
+{
+	struct bt_conn *conn = link->conn;
+
+	if (!conn) {
+		return;
+	}
+
+	/* The central got there first (e.g. encrypted with the stored LTK) */
+	if (bt_conn_get_security(conn) >= BT_SECURITY_L3) {
+		LOG_INF("Link already at L3; no security request needed");
+		return;
+	}
+
+	/* Request MITM (L3) after connect to trigger Numeric Comparison UI on phone.
+	 * For a bonded peer this is a Security Request the central answers by
+	 * encrypting with the stored LTK.
+	 */
+	int err = bt_conn_set_security(conn, BT_SECURITY_L3);
+	if (err) {
+		LOG_WRN("bt_conn_set_security(L3) failed: %d", err);
+	} else {
+		LOG_INF("Requested security level L3 (MITM)");
+	}
+}
+
+static void security_work_fn(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	security_request(CONTAINER_OF(dwork, struct link, security_work));
+	k_mutex_unlock(&app_lock);
+}
+
+/* ---- BLE event handling ----
+ * The connection and pairing callbacks run on the BT RX thread. They only
+ * update the timing stats, take a connection reference and queue a compact
+ * record; ble_wq, a preemptive work queue below the host threads, does the
+ * logging, LED and settings updates and the advertising restarts, under
+ * app_lock.
+ *
+ * A queued record holds its connection, so the host cannot reuse the
+ * object before ble_wq has caught up. The queue covers one lifetime of
+ * every link (connected, security, confirm, cancel, pairing result,
+ * disconnected) plus an end record from each set and one scan request.
+ * Past that only repeated security or pairing records arrive; those are
+ * counted and dropped rather than stalling the RX thread.
+ */
+#define BLE_EVT_PER_LINK 6
+#define BLE_EVT_PER_SETS 5
+
+BUILD_ASSERT(CONFIG_APP_BLE_EVT_QUEUE_LEN >=
+	     CONFIG_BT_MAX_CONN * BLE_EVT_PER_LINK + BLE_EVT_PER_SETS,
+	     "BLE event queue shorter than the worst case");
+
+K_MSGQ_DEFINE(ble_evt_q, sizeof(struct ble_evt), CONFIG_APP_BLE_EVT_QUEUE_LEN, 4);
+static K_THREAD_STACK_DEFINE(ble_wq_stack, CONFIG_APP_BLE_WQ_STACK_SIZE);
+static struct k_work_q ble_wq;
+static struct k_work ble_evt_work;
+
+static void evt_connected(struct bt_conn *conn, uint8_t err)
+{
+	char peer[BT_ADDR_LE_STR_LEN] = {0};
+	struct link *link = link_of(conn);
+	struct bt_conn_info info;
+
+	if (err == BT_HCI_ERR_ADV_TIMEOUT) {
+		/* Directed advertising expired without the peer coming back */
+		reconn_set_ended();
+		return;
+	}
+
+	if (err) {
+		LOG_ERR("Connection failed (err %u)", err);
+		return;
+	}
+
+	link->bonded = bt_conn_get_info(conn, &info) == 0 &&
+		       bonds_is_bonded(info.id, bt_conn_get_dst(conn));
+	link->pairing = false;
+	link->conn = bt_conn_ref(conn);
+
+	if (link->bonded) {
+		bonds_seen(info.id, bt_conn_get_dst(conn));
+	}
+
+	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
+	LOG_INF("Connected: %s%s (%d/%d links)", peer, link->bonded ? " (bonded)" : "",
+		link_count(), CONFIG_BT_MAX_CONN);
+
+	/* For connectable advertising, controller stops advertising when connected */
+	adv_is_running = false;
+	reconn_phase = RECONN_IDLE;
+
+	/* Keep accepting centrals while a connection object is free */
+	if (want_advertising && !links_full()) {
+		adv_sched_reset();
+	} else {
+		adv_sched_cancel();
+	}
+	leds_update();
+
+	conn_policy_connected(conn);
+
+	/* Bonded peers get the security request at once. First-time pairing waits
+	 * a moment so the phone settles before it shows the comparison UI.
+	 */
+	k_work_schedule(&link->security_work,
+			link->bonded ? K_NO_WAIT : K_MSEC(CONFIG_APP_SECURITY_PAIRING_DELAY_MS));
+}
+
+static void evt_disconnected(struct bt_conn *conn, uint8_t reason, uint32_t start_cyc)
+{
+	char peer[BT_ADDR_LE_STR_LEN] = {0};
+
+	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
+	LOG_INF("Disconnected: %s (reason %u)", peer, reason);
+
+	struct link *link = link_of(conn);
+
+	k_work_cancel_delayable(&link->security_work);
+	conn_policy_disconnected(conn);
+
+	if (link->conn) {
+		bt_conn_unref(link->conn);
+		link->conn = NULL;
+	}
+
+	link->pairing = false;
+	leds_update();
+
+	if (want_advertising) {
+		adv_probe_arm(HIST_DISC_TO_ADV, start_cyc);
+	}
+
+	if (want_advertising && IS_ENABLED(CONFIG_APP_RECONNECT)) {
+		struct bt_conn_info info;
+		uint8_t id = bt_conn_get_info(conn, &info) == 0 ? info.id :
+			     adv_id(use_rotating_rpa);
+
+		LOG_INF("Resuming advertising (bonded reconnect first)");
+		reconn_begin(id, bt_conn_get_dst(conn));
+	} else if (want_advertising) {
+		LOG_INF("Resuming advertising (user requested, backoff reset)");
+		adv_sched_reset();
+	}
+}
+
+static void evt_security_changed(struct bt_conn *conn, bt_security_t level,
+				 enum bt_security_err err, uint32_t lat_us)
+{
+	char peer[BT_ADDR_LE_STR_LEN] = {0};
+	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
+
+	LOG_INF("Security changed: %s level=%u err=%u", peer, level, err);
+
+	if (!err && level >= BT_SECURITY_L3) {
+		struct link *link = link_of(conn);
+
+		/* Central-initiated encryption makes our own request redundant */
+		k_work_cancel_delayable(&link->security_work);
+
+		if (lat_us) {
+			hist_record_us(HIST_CONN_TO_L3, lat_us);
+			LOG_INF("Connect -> L3: %u us (%s)", lat_us,
+				link->bonded ? "bonded" : "new pairing");
+		}
+
+		conn_policy_secured(conn);
+
+		if (IS_ENABLED(CONFIG_APP_BENCH_AUTOSTART) && !bench_running()) {
+			bench_start(conn);
+		}
+	}
+}
+
+static void evt_pairing_confirm(struct bt_conn *conn)
+{
+	LOG_INF("Numeric comparison requested -> auto-accepted on peripheral");
+
+	/* Indicate pairing in progress */
+	link_of(conn)->pairing = true;
+	leds_update();
+}
+
+static void evt_pairing_cancel(struct bt_conn *conn)
+{
+	LOG_WRN("Pairing cancelled");
+	link_of(conn)->pairing = false;
+	leds_update();
+}
+
+static void evt_pairing_complete(struct bt_conn *conn, bool bonded)
+{
+	struct bt_conn_info info;
+
+	LOG_INF("Pairing complete (bonded=%d)", bonded);
+	stats_pairing_complete();
+
+	if (bonded && bt_conn_get_info(conn, &info) == 0) {
+		bonds_seen(info.id, bt_conn_get_dst(conn));
+
+		/* The new bond took the spare key slot; free one for the next peer */
+		if (IS_ENABLED(CONFIG_APP_BOND_EVICT)) {
+			bonds_make_room();
+		}
+	}
+
+	link_of(conn)->pairing = false;
+	leds_update();
+}
+
+static void evt_pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
+{
+	LOG_ERR("Pairing failed (reason %d)", reason);
+	stats_pairing_failed();
+	link_of(conn)->pairing = false;
+	leds_update();
 }
 
-static int adv_start(bool rotating_rpa)
+static void ble_evt_handle(const struct ble_evt *evt)
 {
-	if (current_conn) {
-		LOG_INF("Already connected; not starting advertising");
-		return 0;
+	switch (evt->type) {
+	case BLE_EVT_CONNECTED:
+		evt_connected(evt->conn, evt->code);
+		break;
+	case BLE_EVT_DISCONNECTED:
+		evt_disconnected(evt->conn, evt->code, evt->arg);
+		break;
+	case BLE_EVT_SECURITY:
+		evt_security_changed(evt->conn, evt->code, evt->err, evt->arg);
+		break;
+	case BLE_EVT_PAIRING_CONFIRM:
+		evt_pairing_confirm(evt->conn);
+		break;
+	case BLE_EVT_PAIRING_CANCEL:
+		evt_pairing_cancel(evt->conn);
+		break;
+	case BLE_EVT_PAIRING_DONE:
+		evt_pairing_complete(evt->conn, evt->code);
+		break;
+	case BLE_EVT_PAIRING_FAILED:
+		evt_pairing_failed(evt->conn, evt->err);
+		break;
+	case BLE_EVT_ADV_SENT:
+		if (evt->adv == adv_beacon_set) {
+			adv_beacon_sent(evt->arg);
+		} else if (evt->adv == adv_reconn_set) {
+			reconn_set_ended();
+		} else {
+			adv_conn_sent(evt->adv, evt->arg);
+		}
+		break;
+	case BLE_EVT_ADV_SCANNED:
+		atomic_clear(&scan_req_pending);
+		adv_sched_nearby();
+		break;
+	default:
+		break;
 	}
 
-	if (adv_is_running) {
-		LOG_INF("Already advertising; not restarting");
-		return 0;
+	if (evt->conn) {
+		bt_conn_unref(evt->conn);
 	}
+}
 
-	struct bt_le_adv_param param = {
-		.id = BT_ID_DEFAULT,
-		.sid = 0,
-		.secondary_max_skip = 0,
-		.options = BT_LE_ADV_OPT_CONN,
-		.interval_min = BT_GAP_ADV_FAST_INT_MIN_2,
-		.interval_max = BT_GAP_ADV_FAST_INT_MAX_2,
-		.peer = NULL,
-	};
+static void ble_evt_work_fn(struct k_work *work)
+{
+	ARG_UNUSED(work);
 
-	if (!rotating_rpa) {
-		param.options |= BT_LE_ADV_OPT_USE_IDENTITY;
-	}
+	struct ble_evt evt;
 
-	int err = bt_le_adv_start(&param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
-	if (err) {
-		if (err == -EALREADY) {
-			LOG_INF("Advertising already running (EALREADY)");
-			adv_is_running = true;
-			leds_update();
-			return 0;
+	/* Take each record under the lock so an inline drain cannot overtake it */
+	while (1) {
+		k_mutex_lock(&app_lock, K_FOREVER);
+		if (k_msgq_get(&ble_evt_q, &evt, K_NO_WAIT)) {
+			k_mutex_unlock(&app_lock);
+			break;
 		}
-		LOG_ERR("Advertising start failed (err %d)", err);
-		return err;
+		ble_evt_handle(&evt);
+		k_mutex_unlock(&app_lock);
 	}
+}
 
-	adv_is_running = true;
-	LOG_INF("Advertising started (%s), name=%s",
-		rotating_rpa ? "RPA rotating" : "Stable identity",
-		CONFIG_BT_DEVICE_NAME);
+static atomic_t ble_evt_dropped;
 
-	leds_update();
-	return 0;
+/* Losing one of these would leave a link or the backoff stuck */
+static bool ble_evt_critical(const struct ble_evt *evt)
+{
+	return evt->type == BLE_EVT_CONNECTED || evt->type == BLE_EVT_DISCONNECTED ||
+	       evt->type == BLE_EVT_ADV_SENT;
 }
 
-/* ---- Security request work ---- */
-static void security_work_fn(struct k_work *work)
+/* BT RX thread */
+static void ble_evt_post(struct ble_evt *evt, struct bt_conn *conn)
 {
-	ARG_UNUSED(work);
+	struct ble_evt queued;
 
-	if (!current_conn) {
+	evt->conn = conn ? bt_conn_ref(conn) : NULL;
+
+	if (k_msgq_put(&ble_evt_q, evt, K_NO_WAIT) == 0) {
+		k_work_submit_to_queue(&ble_wq, &ble_evt_work);
 		return;
 	}
 
-	/* Request MITM (L3) after connect to trigger Numeric Comparison UI on phone */
-	int err = bt_conn_set_security(current_conn, BT_SECURITY_L3);
-	if (err) {
-		LOG_WRN("bt_conn_set_security(L3) failed: %d", err);
-	} else {
-		LOG_INF("Requested security level L3 (MITM)");
+	if (!ble_evt_critical(evt)) {
+		LOG_WRN("BLE event queue full; dropped type %u (%ld so far)", evt->type,
+			(long)atomic_inc(&ble_evt_dropped) + 1);
+		if (evt->conn) {
+			bt_conn_unref(evt->conn);
+		}
+		return;
+	}
+
+	/* Past the sized worst case; keep the order for the records that matter */
+	LOG_WRN("BLE event queue full; handling type %u on the RX thread", evt->type);
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	while (k_msgq_get(&ble_evt_q, &queued, K_NO_WAIT) == 0) {
+		ble_evt_handle(&queued);
 	}
+	ble_evt_handle(evt);
+	k_mutex_unlock(&app_lock);
 }
 
-/* ---- Connection callbacks ---- */
+/* ---- Connection callbacks ----
+ * Timing stats are taken here so queueing does not skew them.
+ */
 static void connected(struct bt_conn *conn, uint8_t err)
 {
-	char peer[BT_ADDR_LE_STR_LEN] = {0};
-
-	if (err) {
-		LOG_ERR("Connection failed (err %u)", err);
-		return;
+	if (!err) {
+		/* Whichever set was advertising ended with this connection */
+		atomic_clear(&reconn_on_air);
+		stats_adv_stopped();
+		stats_connected(bt_conn_index(conn));
 	}
 
-	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
-	LOG_INF("Connected: %s", peer);
-
-	current_conn = bt_conn_ref(conn);
-
-	/* For connectable advertising, controller stops advertising when connected */
-	adv_is_running = false;
-	leds_update();
-
-	/* Kick off pairing/security a moment after connect */
-	k_work_schedule(&security_work, K_MSEC(200));
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_CONNECTED, .code = err }, conn);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	char peer[BT_ADDR_LE_STR_LEN] = {0};
+	uint32_t cyc = k_cycle_get_32();
 
-	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
-	LOG_INF("Disconnected: %s (reason %u)", peer, reason);
+	stats_disconnected(bt_conn_index(conn));
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_DISCONNECTED, .code = reason,
+					.arg = cyc }, conn);
+}
 
-	k_work_cancel_delayable(&security_work);
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+			     enum bt_security_err err)
+{
+	uint32_t lat_us = 0;
 
-	if (current_conn) {
-		bt_conn_unref(current_conn);
-		current_conn = NULL;
+	if (!err && level >= BT_SECURITY_L3) {
+		lat_us = stats_security_l3(bt_conn_index(conn));
 	}
 
-	gpio_pin_set_dt(&leds[3], 0); /* Clear pairing indicator */
-	leds_update();
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_SECURITY, .code = level,
+					.err = err, .arg = lat_us }, conn);
+}
 
-	if (want_advertising) {
-		LOG_INF("Resuming advertising (user requested)");
-		adv_start(use_rotating_rpa);
-	}
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("Conn params: interval=%u.%02u ms latency=%u timeout=%u ms",
+		interval * 5 / 4, (interval * 125) % 100, latency, timeout * 10);
 }
 
-static void security_changed(struct bt_conn *conn,
-			     bt_security_t level,
-			     enum bt_security_err err)
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
 {
-	char peer[BT_ADDR_LE_STR_LEN] = {0};
-	addr_to_str(bt_conn_get_dst(conn), peer, sizeof(peer));
+	ARG_UNUSED(conn);
 
-	LOG_INF("Security changed: %s level=%u err=%u", peer, level, err);
+	LOG_INF("PHY: tx=%u rx=%u", param->tx_phy, param->rx_phy);
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	ARG_UNUSED(conn);
+
+	LOG_INF("Data length: tx=%u B/%u us rx=%u B/%u us",
+		info->tx_max_len, info->tx_max_time, info->rx_max_len, info->rx_max_time);
 }
 
 static struct bt_conn_cb conn_callbacks = {
 	.connected = connected,
 	.disconnected = disconnected,
 	.security_changed = security_changed,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
 };
 
 /* ---- Pairing/Bonding: Numeric Comparison ----
@@ -275,32 +2125,23 @@ static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
 {
 	ARG_UNUSED(passkey);
 
-	/* Indicate pairing in progress */
-	gpio_pin_set_dt(&leds[3], 1);
-
-	LOG_INF("Numeric comparison requested -> auto-accepting on peripheral");
 	bt_conn_auth_passkey_confirm(conn);
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_PAIRING_CONFIRM }, conn);
 }
 
 static void auth_cancel(struct bt_conn *conn)
 {
-	ARG_UNUSED(conn);
-	LOG_WRN("Pairing cancelled");
-	gpio_pin_set_dt(&leds[3], 0);
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_PAIRING_CANCEL }, conn);
 }
 
 static void pairing_complete(struct bt_conn *conn, bool bonded)
 {
-	ARG_UNUSED(conn);
-	LOG_INF("Pairing complete (bonded=%d)", bonded);
-	gpio_pin_set_dt(&leds[3], 0);
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_PAIRING_DONE, .code = bonded }, conn);
 }
 
 static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 {
-	ARG_UNUSED(conn);
-	LOG_ERR("Pairing failed (reason %d)", reason);
-	gpio_pin_set_dt(&leds[3], 0);
+	ble_evt_post(&(struct ble_evt){ .type = BLE_EVT_PAIRING_FAILED, .err = reason }, conn);
 }
 
 static struct bt_conn_auth_cb auth_cb = {
@@ -309,52 +2150,282 @@ static struct bt_conn_auth_cb auth_cb = {
 	.cancel = auth_cancel,
 };
 
+static void bond_deleted(uint8_t id, const bt_addr_le_t *peer)
+{
+	bonds_deleted(id, peer);
+}
+
 static struct bt_conn_auth_info_cb auth_info_cb = {
 	.pairing_complete = pairing_complete,
 	.pairing_failed = pairing_failed,
+	.bond_deleted = bond_deleted,
 };
 
-/* ---- Init ---- */
-static int init_leds(void)
+/* ---- Runtime tuning (app.h) ----
+ * Called from the shell thread. Values are plain words the other contexts
+ * only read; sets pick up a change when they are next started.
+ */
+void app_adv_tune_get(struct app_adv_tune *out)
 {
-	for (int i = 0; i < NUM_LEDS; i++) {
-		if (!device_is_ready(leds[i].port)) {
-			LOG_ERR("LED %d not ready", i);
-			return -ENODEV;
+	*out = adv_tune;
+}
+
+int app_adv_tune_set(const struct app_adv_tune *in)
+{
+	/* 20 ms is the shortest interval for connectable legacy advertising */
+	if (in->int_min_ms < 20 || in->int_max_ms < in->int_min_ms || in->int_max_ms > 10240 ||
+	    in->burst_ms < 100 || in->burst_ms > 60000 ||
+	    in->growth_pct < 100 || in->growth_pct > 1000 ||
+	    in->downtime_max_ms < CONFIG_APP_ADV_DOWNTIME_MIN_MS ||
+	    in->downtime_max_ms > 3600000) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	adv_tune = *in;
+	adv_downtime_ms = MIN(adv_downtime_ms, adv_tune.downtime_max_ms);
+	adv_tune_gen++;
+	k_mutex_unlock(&app_lock);
+
+	LOG_INF("Tune: interval %u-%u ms, burst %u ms, growth %u%%, cap %u ms",
+		adv_tune.int_min_ms, adv_tune.int_max_ms, adv_tune.burst_ms,
+		adv_tune.growth_pct, adv_tune.downtime_max_ms);
+	return 0;
+}
+
+const char *app_adv_phy_name(unsigned int phy)
+{
+	return phy < ADV_PHY_COUNT ? adv_phy_names[phy] : NULL;
+}
+
+unsigned int app_adv_phy_get(void)
+{
+	return adv_phy;
+}
+
+int app_adv_phy_set(unsigned int phy)
+{
+	if (phy >= ADV_PHY_COUNT) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+	adv_phy = phy;
+	status_changed();
+	k_mutex_unlock(&app_lock);
+	LOG_INF("Tune: PHY profile=%s from next burst", adv_phy_names[phy]);
+	return 0;
+}
+
+static const char *const tx_set_names[APP_TX_SETS] = {
+	"connectable (RPA)", "connectable (identity)", "beacon", "reconnect", "status",
+};
+
+const char *app_tx_set_name(unsigned int set)
+{
+	return set < APP_TX_SETS ? tx_set_names[set] : NULL;
+}
+
+int app_tx_power_set(int8_t dbm, int8_t selected[APP_TX_SETS])
+{
+	struct bt_le_ext_adv *sets[APP_TX_SETS] = {
+		adv_conn_sets[ADV_MODE_RPA], adv_conn_sets[ADV_MODE_IDENTITY],
+		adv_beacon_set, adv_reconn_set, adv_status_set,
+	};
+	int ret = 0;
+
+	k_mutex_lock(&app_lock, K_FOREVER);
+
+	tx_power_set = true;
+	tx_power_dbm = dbm;
+
+	for (int i = 0; i < ARRAY_SIZE(sets); i++) {
+		selected[i] = APP_TX_POWER_NONE;
+
+		int err = adv_tx_power_apply(sets[i], &selected[i]);
+
+		ret = ret ? ret : err;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		uint16_t handle;
+
+		if (links[i].conn && bt_hci_get_conn_handle(links[i].conn, &handle) == 0) {
+			int err = tx_power_write(BT_HCI_VS_LL_HANDLE_TYPE_CONN, handle,
+						 dbm, NULL);
+
+			ret = ret ? ret : err;
+		}
+	}
+
+	k_mutex_unlock(&app_lock);
+	return ret;
+}
+
+bool app_tx_power_get(int8_t *dbm)
+{
+	*dbm = tx_power_dbm;
+	return tx_power_set;
+}
+
+/* ---- Bluetooth bring-up ----
+ * With CONFIG_APP_FAST_BOOT, bt_enable() returns at once and bt_ready()
+ * runs on the system workqueue when the host is up. It loads only the
+ * "bt" subtree (identities and bonds) and the small "bonds" and "app"
+ * subtrees, then starts the first burst. settings_lazy_work then reads the
+ * rest in one backend pass, so a full NVS partition does not delay
+ * advertising.
+ */
+static struct k_work settings_lazy_work;
+static K_SEM_DEFINE(bt_ready_sem, 0, 1);
+static int bt_ready_err;
+
+/* Key under one of the subtrees settings_load_early() already loaded */
+static bool settings_is_early(const char *key)
+{
+	return settings_name_steq(key, "app", NULL) || settings_name_steq(key, "bonds", NULL) ||
+	       settings_name_steq(key, "bt", NULL);
+}
+
+static int settings_lazy_set(const char *key, size_t len, settings_read_cb read_cb,
+			     void *cb_arg, void *param)
+{
+	ARG_UNUSED(param);
+
+	if (settings_is_early(key)) {
+		return 0;
+	}
+
+	/* -ENOENT: no handler for the key, nothing to do */
+	int err = settings_call_set_handler(key, len, read_cb, cb_arg, NULL);
+
+	return err == -ENOENT ? 0 : err;
+}
+
+static void settings_lazy_work_fn(struct k_work *work)
+{
+	int64_t start = k_uptime_get();
+
+	ARG_UNUSED(work);
+
+	/* One pass over the backend for every remaining key, whichever
+	 * handler (static or registered at runtime) owns it; the early
+	 * subtrees are skipped rather than applied twice.
+	 */
+	int err = settings_load_subtree_direct(NULL, settings_lazy_set, NULL);
+
+	if (!err) {
+		err = settings_commit();
+	}
+
+	if (err) {
+		LOG_WRN("Remaining settings load failed (err %d)", err);
+	}
+
+	LOG_INF("Remaining settings loaded in %u ms", (uint32_t)(k_uptime_get() - start));
+}
+
+static int settings_load_early(void)
+{
+	int err;
+
+	if (!IS_ENABLED(CONFIG_APP_FAST_BOOT)) {
+		return settings_load();
+	}
+
+	err = settings_load_subtree("bt");
+	if (err) {
+		return err;
+	}
+
+	err = settings_load_subtree("bonds");
+	if (err) {
+		return err;
+	}
+
+	return settings_load_subtree("app");
+}
+
+/* Everything that needs the host up, in either boot mode */
+static int bt_up(void)
+{
+	int err;
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		err = settings_load_early();
+		if (err) {
+			LOG_WRN("Settings load failed (err %d)", err);
+		} else {
+			LOG_INF("Settings loaded");
 		}
-		gpio_pin_configure_dt(&leds[i], GPIO_OUTPUT_INACTIVE);
 	}
+
+	err = adv_init();
+	if (err) {
+		return err;
+	}
+
+	bonds_init();
+
+	bt_conn_auth_cb_register(&auth_cb);
+	bt_conn_auth_info_cb_register(&auth_info_cb);
+
+	/* Bondable so Android can store keys */
+	bt_set_bondable(true);
+
+	LOG_INF("Ready. Device name=%s", CONFIG_BT_DEVICE_NAME);
+	leds_update();
+
+	if (want_advertising) {
+		LOG_INF("Restored: advertising on, mode=%s, next downtime %u ms",
+			use_rotating_rpa ? "RPA rotating" : "Stable identity", adv_downtime_ms);
+		adv_sched_resume();
+	}
+
+	if (IS_ENABLED(CONFIG_APP_FAST_BOOT) && IS_ENABLED(CONFIG_SETTINGS)) {
+		k_work_submit(&settings_lazy_work);
+	}
+
 	return 0;
 }
 
-static int init_buttons(void)
+/* bt_enable() callback, system workqueue */
+static void bt_ready(int err)
 {
-	if (!device_is_ready(btn_start.port) ||
-	    !device_is_ready(btn_stop.port) ||
-	    !device_is_ready(btn_toggle.port)) {
-		LOG_ERR("Button port not ready");
-		return -ENODEV;
+	if (!err) {
+		k_mutex_lock(&app_lock, K_FOREVER);
+		err = bt_up();
+		k_mutex_unlock(&app_lock);
 	}
 
-	/* Pull-ups are important on DK buttons */
-	gpio_pin_configure_dt(&btn_start,  GPIO_INPUT | GPIO_PULL_UP);
-	gpio_pin_configure_dt(&btn_stop,   GPIO_INPUT | GPIO_PULL_UP);
-	gpio_pin_configure_dt(&btn_toggle, GPIO_INPUT | GPIO_PULL_UP);
+	bt_ready_err = err;
+	k_sem_give(&bt_ready_sem);
+}
+
+/* ---- Init ---- */
+static int init_buttons(void)
+{
+	for (int i = 0; i < NUM_BUTTONS; i++) {
+		struct button *btn = &buttons[i];
+
+		if (!device_is_ready(btn->spec.port)) {
+			LOG_ERR("Button %d port not ready", i);
+			return -ENODEV;
+		}
 
-	gpio_pin_interrupt_configure_dt(&btn_start,  GPIO_INT_EDGE_TO_ACTIVE);
-	gpio_pin_interrupt_configure_dt(&btn_stop,   GPIO_INT_EDGE_TO_ACTIVE);
-	gpio_pin_interrupt_configure_dt(&btn_toggle, GPIO_INT_EDGE_TO_ACTIVE);
+		/* Pull-ups are important on DK buttons */
+		gpio_pin_configure_dt(&btn->spec, GPIO_INPUT | GPIO_PULL_UP);
 
-	gpio_init_callback(&btn_start_cb, isr_start, BIT(btn_start.pin));
-	gpio_add_callback(btn_start.port, &btn_start_cb);
+		k_timer_init(&btn->debounce, btn_debounce_expiry, NULL);
 
-	gpio_init_callback(&btn_stop_cb, isr_stop, BIT(btn_stop.pin));
-	gpio_add_callback(btn_stop.port, &btn_stop_cb);
+		gpio_init_callback(&btn->cb, btn_isr, BIT(btn->spec.pin));
+		gpio_add_callback(btn->spec.port, &btn->cb);
 
-	gpio_init_callback(&btn_toggle_cb, isr_toggle, BIT(btn_toggle.pin));
-	gpio_add_callback(btn_toggle.port, &btn_toggle_cb);
+		gpio_pin_interrupt_configure_dt(&btn->spec, GPIO_INT_EDGE_TO_ACTIVE);
+	}
 
-	LOG_INF("Buttons initialized (sw0/sw1/sw2, pull-ups enabled)");
+	LOG_INF("Buttons initialized (button0..3, pull-ups, %d ms debounce)",
+		CONFIG_APP_BTN_DEBOUNCE_MS);
 	return 0;
 }
 
@@ -363,10 +2434,10 @@ int main(void)
 	int err;
 
 	LOG_INF("Booting...");
-	LOG_INF("=== FW: SW0=start adv, SW1=stop/disconnect, SW2=toggle RPA ===");
+	LOG_INF("=== FW: SW0=start adv, SW1=stop/disconnect, SW2=toggle RPA, SW3=PHY profile (hold: benchmark) ===");
 	LOG_INF("=== Pairing: Numeric Comparison (confirm on phone). Peripheral auto-accepts. ===");
 
-	err = init_leds();
+	err = leds_init();
 	if (err) {
 		return 0;
 	}
@@ -376,69 +2447,134 @@ int main(void)
 		return 0;
 	}
 
+	/* Without a battery reading the nominal profile stays in use */
+	if (IS_ENABLED(CONFIG_APP_BATTERY)) {
+		battery_ok = battery_init() == 0;
+	}
+
 	leds_all_off();
 	leds_update();
 
-	/* Init security work */
-	k_work_init_delayable(&security_work, security_work_fn);
-
-	err = bt_enable(NULL);
-	if (err) {
-		LOG_ERR("Bluetooth init failed (err %d)", err);
-		return 0;
+	for (int i = 0; i < ARRAY_SIZE(links); i++) {
+		k_work_init_delayable(&links[i].security_work, security_work_fn);
 	}
+	k_work_init_delayable(&adv_sched_work, adv_sched_work_fn);
+	k_work_init_delayable(&settings_save_work, settings_save_work_fn);
+	k_work_init(&sysoff_work, sysoff_work_fn);
+	k_work_init(&status_work, status_work_fn);
+	k_work_init(&settings_lazy_work, settings_lazy_work_fn);
+	k_work_init(&ble_evt_work, ble_evt_work_fn);
+	conn_policy_init();
+
+	k_work_queue_start(&ble_wq, ble_wq_stack, K_THREAD_STACK_SIZEOF(ble_wq_stack),
+			   CONFIG_APP_BLE_WQ_PRIORITY,
+			   &(struct k_work_queue_config){ .name = "ble_wq" });
 
 	bt_conn_cb_register(&conn_callbacks);
 
-	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
-		LOG_INF("Settings loaded");
+	if (IS_ENABLED(CONFIG_APP_FAST_BOOT)) {
+		err = bt_enable(bt_ready);
+		if (!err) {
+			/* Presses made meanwhile stay queued in btn_evt_q */
+			k_sem_take(&bt_ready_sem, K_FOREVER);
+			err = bt_ready_err;
+		}
+	} else {
+		err = bt_enable(NULL);
+		if (!err) {
+			k_mutex_lock(&app_lock, K_FOREVER);
+			err = bt_up();
+			k_mutex_unlock(&app_lock);
+		}
 	}
 
-	bt_conn_auth_cb_register(&auth_cb);
-	bt_conn_auth_info_cb_register(&auth_info_cb);
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return 0;
+	}
 
-	/* Bondable so Android can store keys */
-	bt_set_bondable(true);
+	while (1) {
+		struct btn_msg msg;
 
-	LOG_INF("Ready. Device name=%s", CONFIG_BT_DEVICE_NAME);
-	leds_update();
+		/* Sleep until a button ISR posts an event */
+		k_msgq_get(&btn_evt_q, &msg, K_FOREVER);
 
-	while (1) {
-		if (start_pressed) {
-			start_pressed = false;
-			LOG_INF("SW0 pressed -> start advertising");
+		k_mutex_lock(&app_lock, K_FOREVER);
+
+		switch (msg.evt) {
+		case BTN_EVT_START:
+			LOG_INF("SW0 pressed -> start advertising (backoff reset)");
+			adv_probe_arm(HIST_BTN_TO_ADV, msg.isr_cyc);
 			want_advertising = true;
-			adv_start(use_rotating_rpa);
-		}
+			app_state_changed();
+			reconn_cancel();
+			adv_sched_reset();
+			break;
 
-		if (stop_pressed) {
-			stop_pressed = false;
+		case BTN_EVT_STOP:
 			LOG_INF("SW1 pressed -> stop/disconnect");
 			want_advertising = false;
+			app_state_changed();
+			adv_sched_cancel();
+			reconn_cancel();
+			beacon_stop();
+			status_stop();
+
+			for (int i = 0; i < ARRAY_SIZE(links); i++) {
+				if (links[i].conn) {
+					bt_conn_disconnect(links[i].conn,
+							   BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+				}
+			}
 
-			if (current_conn) {
-				bt_conn_disconnect(current_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
-			} else {
+			if (adv_is_running) {
 				adv_stop();
 			}
-		}
+			break;
 
-		if (toggle_pressed) {
-			toggle_pressed = false;
+		case BTN_EVT_TOGGLE:
 			use_rotating_rpa = !use_rotating_rpa;
+			app_state_changed();
 			LOG_INF("SW2 pressed -> mode=%s",
 				use_rotating_rpa ? "RPA rotating" : "Stable identity");
 
-			/* If currently advertising, restart to apply new mode */
+			/* Hand the running burst to the other identity's set */
+			adv_switch_mode(use_rotating_rpa);
+			leds_update();
+			break;
+
+		case BTN_EVT_SW3:
+			adv_phy = (adv_phy + 1) % ADV_PHY_COUNT;
+			LOG_INF("SW3 pressed -> PHY profile=%s", adv_phy_names[adv_phy]);
+			status_changed();
+
+			/* If currently advertising, restart to apply new profile */
 			if (adv_is_running) {
 				adv_stop();
-				adv_start(use_rotating_rpa);
+				if (adv_start(use_rotating_rpa)) {
+					adv_sched_burst_done();
+				}
 			}
-			leds_update();
+			break;
+
+		case BTN_EVT_SW3_HOLD: {
+			struct bt_conn *conn = link_any();
+
+			if (!conn) {
+				LOG_WRN("SW3 held -> benchmark needs a connected peer");
+				break;
+			}
+
+			LOG_INF("SW3 held -> GATT benchmark");
+			bench_start(conn);
+			break;
+		}
+
+		default:
+			break;
 		}
 
-		k_msleep(20);
+		k_mutex_unlock(&app_lock);
 	}
 
 	return 0;
@@ -0,0 +1,193 @@
+/*
+ * service.c
+ * 0x2222 service.
+ *   0x2223 Stats (read): stats_encode() snapshot, little-endian uint32 fields
+ *          uptime, adv_on, connected, idle (ms), adv_starts, connections,
+ *          pairing_ok, pairing_failed, L3 count, L3 latency min/avg/max (us),
+ *          boot -> first advertising (ms), data notifications sent, bytes,
+ *          failed, stalls, last benchmark B/s and notifications per
+ *          connection event x100.
+ *   0x2224 Data (notify): batches of samples pushed with service_data_push().
+ *          Batches live in a fixed slab; a block returns to the slab when the
+ *          stack reports the notification as sent, so the slab also bounds
+ *          the number of notifications in flight.
+ *   0x2225 Latency histograms (read): hist_encode() snapshot, HIST_BUCKETS
+ *          little-endian uint32 bucket counts per histogram in hist_id order.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+
+#include "conn_policy.h"
+#include "hist.h"
+#include "service.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(service, LOG_LEVEL_INF);
+
+#define ATT_NOTIFY_HDR_LEN 3
+#define DATA_BLOCK_LEN (CONFIG_BT_L2CAP_TX_MTU - ATT_NOTIFY_HDR_LEN)
+
+struct data_block {
+	uint16_t len;
+	uint8_t data[DATA_BLOCK_LEN];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(data_slab, ROUND_UP(sizeof(struct data_block), 4),
+			 CONFIG_APP_SVC_DATA_BUFS, 4);
+
+static struct data_block *batch; /* Block being filled, NULL if none */
+static bool stalled;             /* Last push found no free buffer */
+
+/* Snapshot taken on the first chunk so a long read stays consistent */
+static uint8_t stats_value[STATS_ENCODED_LEN];
+
+static ssize_t read_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset)
+{
+	if (offset == 0) {
+		stats_encode(stats_value, sizeof(stats_value));
+	}
+
+	conn_policy_activity(conn);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset,
+				 stats_value, sizeof(stats_value));
+}
+
+static uint8_t hist_value[HIST_ENCODED_LEN];
+
+static ssize_t read_hist(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 void *buf, uint16_t len, uint16_t offset)
+{
+	if (offset == 0) {
+		hist_encode(hist_value, sizeof(hist_value));
+	}
+
+	conn_policy_activity(conn);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset,
+				 hist_value, sizeof(hist_value));
+}
+
+static void data_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	ARG_UNUSED(attr);
+
+	LOG_INF("Data notifications %s", value == BT_GATT_CCC_NOTIFY ? "on" : "off");
+}
+
+BT_GATT_SERVICE_DEFINE(app_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_APP_SVC),
+	BT_GATT_CHARACTERISTIC(BT_UUID_APP_STATS, BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, read_stats, NULL, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_APP_DATA, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(data_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_APP_HIST, BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, read_hist, NULL, NULL),
+);
+
+#define DATA_ATTR (&app_svc.attrs[4])
+
+bool service_data_subscribed(struct bt_conn *conn)
+{
+	return bt_gatt_is_subscribed(conn, DATA_ATTR, BT_GATT_CCC_NOTIFY);
+}
+
+/* TX context: the stack is done with the notification */
+static void data_sent(struct bt_conn *conn, void *user_data)
+{
+	struct data_block *blk = user_data;
+
+	ARG_UNUSED(conn);
+
+	stats_notify_sent(blk->len);
+	k_mem_slab_free(&data_slab, blk);
+}
+
+/* Counted once per run of pushes that found no buffer, not per retry */
+static int data_stall(int err)
+{
+	if (!stalled) {
+		stalled = true;
+		stats_notify_stall();
+	}
+
+	return err;
+}
+
+static int batch_send(struct bt_conn *conn)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = DATA_ATTR,
+		.data = batch->data,
+		.len = batch->len,
+		.func = data_sent,
+		.user_data = batch,
+	};
+	int err;
+
+	err = bt_gatt_notify_cb(conn, &params);
+	if (err == -ENOMEM) {
+		/* Keep the batch, the caller retries once TX buffers free up */
+		return data_stall(-EAGAIN);
+	}
+
+	if (err) {
+		/* Link gone or peer unsubscribed: the batch has nowhere to go */
+		stats_notify_failed();
+		k_mem_slab_free(&data_slab, batch);
+	}
+
+	batch = NULL;
+
+	return err;
+}
+
+int service_data_push(struct bt_conn *conn, const void *data, uint16_t len)
+{
+	uint16_t max = MIN(bt_gatt_get_mtu(conn) - ATT_NOTIFY_HDR_LEN, DATA_BLOCK_LEN);
+	int err;
+
+	if (len > max) {
+		return -EMSGSIZE;
+	}
+
+	if (batch && batch->len + len > max) {
+		err = batch_send(conn);
+		if (err) {
+			return err;
+		}
+	}
+
+	if (!batch) {
+		if (k_mem_slab_alloc(&data_slab, (void **)&batch, K_NO_WAIT)) {
+			batch = NULL;
+			return data_stall(-ENOMEM);
+		}
+		batch->len = 0;
+	}
+
+	memcpy(&batch->data[batch->len], data, len);
+	batch->len += len;
+	stalled = false;
+
+	return 0;
+}
+
+int service_data_flush(struct bt_conn *conn)
+{
+	if (!batch) {
+		return 0;
+	}
+
+	return batch_send(conn);
+}
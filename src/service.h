@@ -0,0 +1,41 @@
+/*
+ * service.h
+ * The 0x2222 GATT service advertised in uuid_custom_service.
+ */
+
+#ifndef SERVICE_H_
+#define SERVICE_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/uuid.h>
+
+/* 00002222-0000-1000-8000-00805f9b34fb is the SIG-base form of 0x2222 */
+#define BT_UUID_APP_SVC_VAL   0x2222
+#define BT_UUID_APP_STATS_VAL 0x2223
+#define BT_UUID_APP_DATA_VAL  0x2224
+#define BT_UUID_APP_HIST_VAL  0x2225
+
+#define BT_UUID_APP_SVC   BT_UUID_DECLARE_16(BT_UUID_APP_SVC_VAL)
+#define BT_UUID_APP_STATS BT_UUID_DECLARE_16(BT_UUID_APP_STATS_VAL)
+#define BT_UUID_APP_DATA  BT_UUID_DECLARE_16(BT_UUID_APP_DATA_VAL)
+#define BT_UUID_APP_HIST  BT_UUID_DECLARE_16(BT_UUID_APP_HIST_VAL)
+
+/* True if the peer enabled notifications on the data characteristic */
+bool service_data_subscribed(struct bt_conn *conn);
+
+/*
+ * Append a sample to the current batch. A batch is sent as one notification
+ * once the next sample would not fit in ATT MTU - 3 bytes. Returns -ENOMEM
+ * when all batch buffers are in flight and -EAGAIN when the stack has no TX
+ * buffer; the sample was not queued in either case. Call from one thread.
+ */
+int service_data_push(struct bt_conn *conn, const void *data, uint16_t len);
+
+/* Send a partially filled batch now. On -EAGAIN the batch is kept and the
+ * caller should retry; any other error drops it.
+ */
+int service_data_flush(struct bt_conn *conn);
+
+#endif /* SERVICE_H_ */
@@ -0,0 +1,216 @@
+/*
+ * stats.c
+ * Running totals kept with k_uptime_get() (durations) and k_cycle_get_32()
+ * (latencies). Called from the main thread, the system workqueue and the
+ * BT RX thread, so everything is under one spinlock.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "stats.h"
+
+static struct k_spinlock lock;
+
+static int64_t adv_on_since;     /* 0 when not advertising */
+static int64_t connected_since;  /* 0 when not connected */
+static uint64_t adv_on_total_ms;
+static uint64_t connected_total_ms;
+
+static uint32_t boot_to_adv_ms;
+static uint32_t adv_starts;
+static uint32_t connections;
+static uint32_t pairing_ok;
+static uint32_t pairing_failed;
+
+static uint32_t ntf_sent;
+static uint32_t ntf_bytes;
+static uint32_t ntf_failed;
+static uint32_t ntf_stalls;
+static uint32_t bench_bytes_per_s;
+static uint32_t bench_ntf_per_evt_x100;
+
+/* Per link, indexed by bt_conn_index() */
+static uint32_t connected_cyc[CONFIG_BT_MAX_CONN];
+static bool l3_pending[CONFIG_BT_MAX_CONN];  /* Link has not reached L3 yet */
+static uint8_t links_up;
+static uint32_t sec_lat_count;
+static uint32_t sec_lat_min_us = UINT32_MAX;
+static uint32_t sec_lat_max_us;
+static uint64_t sec_lat_sum_us;
+
+void stats_adv_started(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (!adv_on_since) {
+		adv_on_since = k_uptime_get();
+		adv_starts++;
+		if (!boot_to_adv_ms) {
+			boot_to_adv_ms = MAX((uint32_t)adv_on_since, 1U);
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void stats_adv_stopped(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (adv_on_since) {
+		adv_on_total_ms += k_uptime_get() - adv_on_since;
+		adv_on_since = 0;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void stats_connected(uint8_t link)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	connected_cyc[link] = k_cycle_get_32();
+	l3_pending[link] = true;
+	connections++;
+	links_up++;
+
+	if (!connected_since) {
+		connected_since = k_uptime_get();
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void stats_disconnected(uint8_t link)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	l3_pending[link] = false;
+	if (links_up) {
+		links_up--;
+	}
+
+	/* connected_ms counts time with at least one link up */
+	if (!links_up && connected_since) {
+		connected_total_ms += k_uptime_get() - connected_since;
+		connected_since = 0;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+uint32_t stats_security_l3(uint8_t link)
+{
+	uint32_t lat_us = 0;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (l3_pending[link]) {
+		l3_pending[link] = false;
+		lat_us = k_cyc_to_us_floor32(k_cycle_get_32() - connected_cyc[link]);
+
+		sec_lat_count++;
+		sec_lat_sum_us += lat_us;
+		sec_lat_min_us = MIN(sec_lat_min_us, lat_us);
+		sec_lat_max_us = MAX(sec_lat_max_us, lat_us);
+	}
+
+	k_spin_unlock(&lock, key);
+	return lat_us;
+}
+
+void stats_pairing_complete(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	pairing_ok++;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_pairing_failed(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	pairing_failed++;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_notify_sent(uint16_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	ntf_sent++;
+	ntf_bytes += len;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_notify_failed(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	ntf_failed++;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_notify_stall(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	ntf_stalls++;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_bench_result(uint32_t bytes_per_s, uint32_t ntf_per_evt_x100)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	bench_bytes_per_s = bytes_per_s;
+	bench_ntf_per_evt_x100 = ntf_per_evt_x100;
+	k_spin_unlock(&lock, key);
+}
+
+void stats_get(struct stats_snapshot *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint64_t now = k_uptime_get();
+	uint64_t adv_ms = adv_on_total_ms + (adv_on_since ? now - adv_on_since : 0);
+	uint64_t conn_ms = connected_total_ms + (connected_since ? now - connected_since : 0);
+
+	out->uptime_ms = (uint32_t)now;
+	out->adv_on_ms = (uint32_t)adv_ms;
+	out->connected_ms = (uint32_t)conn_ms;
+	out->idle_ms = (uint32_t)((adv_ms + conn_ms < now) ? now - adv_ms - conn_ms : 0);
+	out->adv_starts = adv_starts;
+	out->connections = connections;
+	out->pairing_ok = pairing_ok;
+	out->pairing_failed = pairing_failed;
+	out->sec_lat_count = sec_lat_count;
+	out->sec_lat_min_us = sec_lat_count ? sec_lat_min_us : 0;
+	out->sec_lat_avg_us = sec_lat_count ? (uint32_t)(sec_lat_sum_us / sec_lat_count) : 0;
+	out->sec_lat_max_us = sec_lat_max_us;
+	out->boot_to_adv_ms = boot_to_adv_ms;
+	out->ntf_sent = ntf_sent;
+	out->ntf_bytes = ntf_bytes;
+	out->ntf_failed = ntf_failed;
+	out->ntf_stalls = ntf_stalls;
+	out->bench_bytes_per_s = bench_bytes_per_s;
+	out->bench_ntf_per_evt_x100 = bench_ntf_per_evt_x100;
+
+	k_spin_unlock(&lock, key);
+}
+
+/* Snapshot as consecutive little-endian uint32 fields, in struct order */
+size_t stats_encode(uint8_t *buf, size_t len)
+{
+	struct stats_snapshot snap;
+	const uint32_t *fields = (const uint32_t *)&snap;
+	size_t n = MIN(len / sizeof(uint32_t), STATS_ENCODED_LEN / sizeof(uint32_t));
+
+	stats_get(&snap);
+
+	for (size_t i = 0; i < n; i++) {
+		sys_put_le32(fields[i], &buf[i * sizeof(uint32_t)]);
+	}
+
+	return n * sizeof(uint32_t);
+}
@@ -0,0 +1,58 @@
+/*
+ * stats.h
+ * On-target counters: time spent advertising/connected/idle, link events,
+ * connect -> L3 security latency, and data characteristic throughput.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct stats_snapshot {
+	uint32_t uptime_ms;
+	uint32_t adv_on_ms;       /* Connectable set enabled */
+	uint32_t connected_ms;    /* At least one link up */
+	uint32_t idle_ms;         /* Neither advertising nor connected */
+	uint32_t adv_starts;
+	uint32_t connections;
+	uint32_t pairing_ok;
+	uint32_t pairing_failed;
+	uint32_t sec_lat_count;   /* Links that reached L3 */
+	uint32_t sec_lat_min_us;
+	uint32_t sec_lat_avg_us;
+	uint32_t sec_lat_max_us;
+	uint32_t boot_to_adv_ms;  /* Uptime at the first advertising start, 0 before */
+	uint32_t ntf_sent;        /* Data notifications completed by the stack */
+	uint32_t ntf_bytes;
+	uint32_t ntf_failed;      /* Batches dropped on a send error */
+	uint32_t ntf_stalls;      /* Times a push found no free buffer */
+	uint32_t bench_bytes_per_s;       /* Last benchmark run, 0 before */
+	uint32_t bench_ntf_per_evt_x100;
+};
+
+/* Size of the little-endian wire format produced by stats_encode() */
+#define STATS_ENCODED_LEN (sizeof(struct stats_snapshot))
+
+void stats_adv_started(void);
+void stats_adv_stopped(void);
+/* link is bt_conn_index() of the connection */
+void stats_connected(uint8_t link);
+void stats_disconnected(uint8_t link);
+
+/* First L3 on the link; returns the connect -> L3 latency in us */
+uint32_t stats_security_l3(uint8_t link);
+
+void stats_pairing_complete(void);
+void stats_pairing_failed(void);
+
+void stats_notify_sent(uint16_t len);
+void stats_notify_failed(void);
+void stats_notify_stall(void);
+void stats_bench_result(uint32_t bytes_per_s, uint32_t ntf_per_evt_x100);
+
+void stats_get(struct stats_snapshot *out);
+size_t stats_encode(uint8_t *buf, size_t len);
+
+#endif /* STATS_H_ */
@@ -0,0 +1,286 @@
+/*
+ * main.c
+ * Scripted central for the nrf52_bsim discovery benchmark. Waits
+ * CONFIG_CENTRAL_SCAN_DELAY_MS, scans 1M and Coded for a connectable
+ * report carrying the app's 0x2222 service UUID, connects, pairs to L3
+ * (confirming the Numeric Comparison itself) and reads the peripheral's
+ * stats characteristic. One "RESULT" line reports the times from scan
+ * start and the peripheral's advertising counters; run.sh collects it.
+ * Simulated time is exact, so the numbers repeat from run to run.
+ */
+
+#include <stddef.h>
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+/* The peripheral's UUIDs and stats layout, so the two cannot drift */
+#include "service.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(central, LOG_LEVEL_INF);
+
+#define SCAN_INT BT_GAP_MS_TO_SCAN_INTERVAL(CONFIG_CENTRAL_SCAN_INT_MS)
+
+static struct bt_conn *conn;
+
+/* k_uptime_get_32() at each milestone, 0 until reached */
+static uint32_t t_scan;
+static uint32_t t_found;
+static uint32_t t_conn;
+static uint32_t t_l3;
+static uint8_t found_phy;
+
+static struct bt_gatt_exchange_params mtu_params;
+static struct bt_gatt_read_params read_params;
+
+static void scan_start(void);
+
+/* ---- Discovery ---- */
+static bool ad_has_app_uuid(struct bt_data *data, void *user_data)
+{
+	bool *match = user_data;
+
+	if (data->type != BT_DATA_UUID128_ALL && data->type != BT_DATA_UUID128_SOME) {
+		return true;
+	}
+
+	for (size_t i = 0; i + BT_UUID_SIZE_128 <= data->data_len; i += BT_UUID_SIZE_128) {
+		struct bt_uuid_128 uuid;
+
+		if (bt_uuid_create(&uuid.uuid, &data->data[i], BT_UUID_SIZE_128) &&
+		    bt_uuid_cmp(&uuid.uuid, BT_UUID_APP_SVC) == 0) {
+			*match = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf)
+{
+	bool match = false;
+	int err;
+
+	if (conn || !(info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE)) {
+		return;
+	}
+
+	bt_data_parse(buf, ad_has_app_uuid, &match);
+	if (!match) {
+		return;
+	}
+
+	if (!t_found) {
+		t_found = k_uptime_get_32();
+		found_phy = info->primary_phy;
+	}
+
+	err = bt_le_scan_stop();
+	if (err) {
+		LOG_ERR("Scan stop failed (err %d)", err);
+		return;
+	}
+
+	/* Initiate on the PHY the report came in on; Coded needs its own option */
+	const struct bt_conn_le_create_param *create =
+		info->primary_phy == BT_GAP_LE_PHY_CODED ?
+		BT_CONN_LE_CREATE_PARAM(BT_CONN_LE_OPT_CODED | BT_CONN_LE_OPT_NO_1M,
+					SCAN_INT, SCAN_INT) :
+		BT_CONN_LE_CREATE_PARAM(BT_CONN_LE_OPT_NONE, SCAN_INT, SCAN_INT);
+
+	err = bt_conn_le_create(info->addr, create, BT_LE_CONN_PARAM_DEFAULT, &conn);
+	if (err) {
+		LOG_ERR("Create connection failed (err %d)", err);
+		scan_start();
+	}
+}
+
+static struct bt_le_scan_cb scan_cb = {
+	.recv = scan_recv,
+};
+
+static void scan_start(void)
+{
+	struct bt_le_scan_param param = {
+		.type = BT_LE_SCAN_TYPE_ACTIVE,
+		.options = BT_LE_SCAN_OPT_CODED,
+		.interval = SCAN_INT,
+		.window = SCAN_INT,
+		.interval_coded = SCAN_INT,
+		.window_coded = SCAN_INT,
+	};
+	int err = bt_le_scan_start(&param, NULL);
+
+	if (err) {
+		LOG_ERR("Scan start failed (err %d)", err);
+		return;
+	}
+
+	if (!t_scan) {
+		t_scan = k_uptime_get_32();
+		LOG_INF("Scanning (1M + Coded)");
+	}
+}
+
+/* ---- Report ---- */
+static uint32_t field(const uint8_t *data, uint16_t len, size_t offset)
+{
+	return offset + sizeof(uint32_t) <= len ? sys_get_le32(&data[offset]) : 0;
+}
+
+static uint8_t stats_read(struct bt_conn *c, uint8_t err, struct bt_gatt_read_params *params,
+			  const void *data, uint16_t len)
+{
+	ARG_UNUSED(params);
+
+	if (err) {
+		LOG_ERR("Stats read failed (ATT err 0x%02x)", err);
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (!data) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	/* Milestones from scan start; the peripheral's counters at the
+	 * moment of the read, adv_on_ms over uptime_ms being its duty cycle
+	 */
+	LOG_INF("RESULT found_ms=%u conn_ms=%u l3_ms=%u phy=%u "
+		"uptime_ms=%u adv_on_ms=%u adv_starts=%u boot_to_adv_ms=%u",
+		t_found - t_scan, t_conn - t_scan, t_l3 - t_scan, found_phy,
+		field(data, len, offsetof(struct stats_snapshot, uptime_ms)),
+		field(data, len, offsetof(struct stats_snapshot, adv_on_ms)),
+		field(data, len, offsetof(struct stats_snapshot, adv_starts)),
+		field(data, len, offsetof(struct stats_snapshot, boot_to_adv_ms)));
+
+	return BT_GATT_ITER_STOP;
+}
+
+static void mtu_exchanged(struct bt_conn *c, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	ARG_UNUSED(params);
+
+	if (err) {
+		LOG_WRN("MTU exchange failed (err %u); stats may be truncated", err);
+	}
+
+	read_params.func = stats_read;
+	read_params.handle_count = 0;
+	read_params.by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	read_params.by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	read_params.by_uuid.uuid = BT_UUID_APP_STATS;
+
+	int rc = bt_gatt_read(c, &read_params);
+	if (rc) {
+		LOG_ERR("Stats read not sent (err %d)", rc);
+	}
+}
+
+/* ---- Connection and security ---- */
+static void connected(struct bt_conn *c, uint8_t err)
+{
+	if (err) {
+		LOG_WRN("Connection failed (err %u); scanning again", err);
+		bt_conn_unref(conn);
+		conn = NULL;
+		scan_start();
+		return;
+	}
+
+	t_conn = k_uptime_get_32();
+	LOG_INF("Connected");
+
+	int rc = bt_conn_set_security(c, BT_SECURITY_L3);
+	if (rc) {
+		LOG_ERR("Security request failed (err %d)", rc);
+	}
+}
+
+static void disconnected(struct bt_conn *c, uint8_t reason)
+{
+	LOG_INF("Disconnected (reason 0x%02x)", reason);
+
+	if (c == conn) {
+		bt_conn_unref(conn);
+		conn = NULL;
+	}
+}
+
+static void security_changed(struct bt_conn *c, bt_security_t level, enum bt_security_err err)
+{
+	if (err || level < BT_SECURITY_L3 || t_l3) {
+		if (err) {
+			LOG_ERR("Security failed (level %u, err %d)", level, err);
+		}
+		return;
+	}
+
+	t_l3 = k_uptime_get_32();
+	LOG_INF("Link at L3");
+
+	mtu_params.func = mtu_exchanged;
+	if (bt_gatt_exchange_mtu(c, &mtu_params)) {
+		mtu_exchanged(c, BT_ATT_ERR_UNLIKELY, &mtu_params);
+	}
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.security_changed = security_changed,
+};
+
+/* Both sides display; accepting here stands in for the user on the phone */
+static void auth_passkey_display(struct bt_conn *c, unsigned int passkey)
+{
+	ARG_UNUSED(c);
+	ARG_UNUSED(passkey);
+}
+
+static void auth_passkey_confirm(struct bt_conn *c, unsigned int passkey)
+{
+	ARG_UNUSED(passkey);
+
+	bt_conn_auth_passkey_confirm(c);
+}
+
+static void auth_cancel(struct bt_conn *c)
+{
+	ARG_UNUSED(c);
+
+	LOG_WRN("Pairing cancelled");
+}
+
+static struct bt_conn_auth_cb auth_cb = {
+	.passkey_display = auth_passkey_display,
+	.passkey_confirm = auth_passkey_confirm,
+	.cancel = auth_cancel,
+};
+
+int main(void)
+{
+	int err;
+
+	bt_conn_auth_cb_register(&auth_cb);
+	bt_le_scan_cb_register(&scan_cb);
+
+	err = bt_enable(NULL);
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return 0;
+	}
+
+	k_sleep(K_MSEC(CONFIG_CENTRAL_SCAN_DELAY_MS));
+	scan_start();
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+# Shared by compile.sh and run.sh; sourced, not run.
+#
+# Needs the usual BabbleSim environment: ZEPHYR_BASE, BSIM_OUT_PATH and
+# BSIM_COMPONENTS_PATH, with bs_2G4_phy_v1 built into ${BSIM_OUT_PATH}/bin.
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE is not set}"
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH is not set}"
+
+TESTS_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+APP_DIR=$(cd "${TESTS_DIR}/../.." && pwd)
+BUILD_DIR=${BUILD_DIR:-${BSIM_OUT_PATH}/disc_build}
+BIN_DIR=${BSIM_OUT_PATH}/bin
+
+# Boards the app is built for. nrf5340bsim runs the app and host on the
+# application core and ipc_radio on the network core, like the nRF5340 DK
+# build; nrf52_bsim has the controller in the app image like the nRF52 DKs.
+PERIPH_BOARDS=${PERIPH_BOARDS:-"nrf52_bsim nrf5340bsim/nrf5340/cpuapp"}
+
+# The scripted central stands in for the phone and is the same for all
+CENTRAL_BOARD=nrf52_bsim
+
+# Peripheral builds: one per board and variants/<name>.conf on top of prj.conf
+VARIANTS=${VARIANTS:-"default backoff_flat backoff_steep jitter_off jitter_max phy_2m phy_coded"}
+
+# Central builds: one per delay before the first scan. 0 finds the first
+# burst; the others arrive after several downtimes of the backoff.
+SCAN_DELAYS_MS=${SCAN_DELAYS_MS:-"0 20000 90000"}
+
+board_ts() { echo "${1//\//_}"; }
+periph_exe() { echo "bs_$(board_ts "$1")_disc_periph_$2"; }
+central_exe() { echo "bs_$(board_ts "${CENTRAL_BOARD}")_disc_central_$1"; }
+
+# GPIO0 pins of buttons SW0..SW3 in the board overlays
+board_buttons() {
+	case "$1" in
+	nrf5340bsim*) echo "23 24 8 9" ;;
+	*) echo "13 14 15 16" ;;
+	esac
+}
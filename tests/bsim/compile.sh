@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Build the app for each bsim board once per variant and the scripted
+# central once per scan delay, and install them into ${BSIM_OUT_PATH}/bin.
+#
+#   tests/bsim/compile.sh
+#   PERIPH_BOARDS=nrf52_bsim VARIANTS="default phy_coded" SCAN_DELAYS_MS=0 \
+#     tests/bsim/compile.sh
+
+set -ue
+
+source "$(dirname "$0")/common.sh"
+
+build() {
+	local name=$1 board=$2 src=$3 exe=$4
+	local sysbuild=--no-sysbuild
+	shift 4
+
+	# The network core image and the merged executable come from sysbuild;
+	# the final zephyr.exe lands in the top build directory either way
+	case "${board}" in
+	nrf5340bsim*) sysbuild=--sysbuild ;;
+	esac
+
+	west build ${sysbuild} -p auto -b "${board}" -d "${BUILD_DIR}/${name}" \
+		"${src}" -- "$@"
+	cp "${BUILD_DIR}/${name}/zephyr/zephyr.exe" "${BIN_DIR}/${exe}"
+}
+
+mkdir -p "${BUILD_DIR}" "${BIN_DIR}"
+
+for b in ${PERIPH_BOARDS}; do
+	for v in ${VARIANTS}; do
+		build "periph_$(board_ts "${b}")_${v}" "${b}" "${APP_DIR}" \
+			"$(periph_exe "${b}" "${v}")" \
+			-DEXTRA_CONF_FILE="${TESTS_DIR}/variants/${v}.conf"
+	done
+done
+
+for d in ${SCAN_DELAYS_MS}; do
+	build "central_${d}" "${CENTRAL_BOARD}" "${TESTS_DIR}/central" \
+		"$(central_exe "${d}")" -DCONFIG_CENTRAL_SCAN_DELAY_MS="${d}"
+done
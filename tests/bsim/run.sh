@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+# Run every board and variant against every central scan delay in the 2G4
+# phy and report, per run:
+#   found_ms  first connectable report with the app UUID, from scan start
+#   conn_ms   connection established, from scan start
+#   l3_ms     link at security L3, from scan start
+#   tx_pct    peripheral radio TX airtime / simulated time, boot to connect
+#             (from the phy's dump, so it counts beacon and status sets too)
+#   adv_pct   adv_on_ms / uptime_ms from the app's stats characteristic
+# The table goes to stdout and ${BUILD_DIR}/results.csv. Exits non-zero if
+# any run did not reach L3. Build first with compile.sh.
+#
+# Comparing boards: the simulation has no power model, so tx_pct is the
+# radio side only. What the nRF5340 split saves (the app core asleep while
+# the network core runs the bursts) needs a current measurement on the DKs.
+
+set -ue
+
+source "$(dirname "$0")/common.sh"
+
+# Simulated time after the scan delay for the central to get to L3
+RUN_MARGIN_MS=${RUN_MARGIN_MS:-60000}
+
+mkdir -p "${BUILD_DIR}/logs"
+
+# SW0 (active low) pressed at 0.5 s to start advertising; the other buttons
+# held released. nRF GPIO model input: <time_us> <port> <pin> <level>
+gpio_in() {
+	local file="${BUILD_DIR}/sw0_press_$(board_ts "$1").txt"
+	local pins=($(board_buttons "$1"))
+
+	{
+		for pin in "${pins[@]}"; do
+			echo "0 0 ${pin} 1"
+		done
+		echo "500000 0 ${pins[0]} 0"
+		echo "600000 0 ${pins[0]} 1"
+	} > "${file}"
+
+	echo "${file}"
+}
+
+# Sum of TX airtime of device 0 that started before end_us, in percent of it
+tx_pct() {
+	if [ ! -f "$1" ]; then
+		echo "n/a"
+		return
+	fi
+
+	awk -F, -v end="$2" '
+		NR == 1 {
+			for (i = 1; i <= NF; i++) {
+				if ($i == "start_time") s = i
+				if ($i == "end_time") e = i
+			}
+			next
+		}
+		s && e && $s < end { on += ($e < end ? $e : end) - $s }
+		END { printf "%.2f", (end > 0 ? 100 * on / end : 0) }
+	' "$1"
+}
+
+result_field() {
+	sed -n "s/.*RESULT.* $2=\([0-9]*\).*/\1/p" "$1" | head -n 1
+}
+
+failed=0
+csv="${BUILD_DIR}/results.csv"
+echo "board,variant,scan_delay_ms,found_ms,conn_ms,l3_ms,tx_pct,adv_pct" > "${csv}"
+printf "%-24s %-14s %10s %9s %9s %9s %7s %7s\n" \
+	board variant delay_ms found_ms conn_ms l3_ms tx_pct adv_pct
+
+for b in ${PERIPH_BOARDS}; do
+	gpio=$(gpio_in "${b}")
+
+	for v in ${VARIANTS}; do
+		for d in ${SCAN_DELAYS_MS}; do
+			sim_id="disc_$(board_ts "${b}")_${v}_${d}"
+			log="${BUILD_DIR}/logs/${sim_id}"
+
+			(
+				cd "${BIN_DIR}"
+				./bs_2G4_phy_v1 -s="${sim_id}" -D=2 -dump \
+					-sim_length=$(( (d + RUN_MARGIN_MS) * 1000 )) \
+					> "${log}.phy.log" 2>&1 &
+				./"$(periph_exe "${b}" "${v}")" -s="${sim_id}" -d=0 -rs=23 \
+					-RealEncryption=1 -gpio_in_file="${gpio}" \
+					> "${log}.periph.log" 2>&1 &
+				./"$(central_exe "${d}")" -s="${sim_id}" -d=1 -rs=57 \
+					-RealEncryption=1 > "${log}.central.log" 2>&1 &
+				wait
+			)
+
+			if ! grep -q RESULT "${log}.central.log"; then
+				printf "%-24s %-14s %10s  no L3, see %s.*.log\n" \
+					"${b}" "${v}" "${d}" "${log}"
+				echo "${b},${v},${d},,,,," >> "${csv}"
+				failed=1
+				continue
+			fi
+
+			found=$(result_field "${log}.central.log" found_ms)
+			conn=$(result_field "${log}.central.log" conn_ms)
+			l3=$(result_field "${log}.central.log" l3_ms)
+			uptime=$(result_field "${log}.central.log" uptime_ms)
+			adv_on=$(result_field "${log}.central.log" adv_on_ms)
+
+			# Both devices start at simulated time 0
+			tx=$(tx_pct "${BSIM_OUT_PATH}/results/${sim_id}/d_2G4_00.Tx.csv" \
+				$(( (d + conn) * 1000 )))
+			adv=$(awk -v on="${adv_on}" -v up="${uptime}" \
+				'BEGIN { printf "%.2f", (up > 0 ? 100 * on / up : 0) }')
+
+			printf "%-24s %-14s %10s %9s %9s %9s %7s %7s\n" "${b}" "${v}" "${d}" \
+				"${found}" "${conn}" "${l3}" "${tx}" "${adv}"
+			echo "${b},${v},${d},${found},${conn},${l3},${tx},${adv}" >> "${csv}"
+		done
+	done
+done
+
+exit ${failed}